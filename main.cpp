@@ -1,21 +1,68 @@
 ﻿#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <queue>
+#include <random>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PROYECTO_USA_MMAP 1
+#else
+#define PROYECTO_USA_MMAP 0
+#endif
+
+// Ruta AVX2/POPCNT de IndiceBitmap, elegida al ejecutar segun la CPU; -DPROYECTO_AVX2=0 la elimina.
+#ifndef PROYECTO_AVX2
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define PROYECTO_AVX2 1
+#else
+#define PROYECTO_AVX2 0
+#endif
+#endif
+#if PROYECTO_AVX2
+#include <immintrin.h>
+#endif
+
+// Instrumentacion de fases y contadores; compilar con -DPROYECTO_ESTADISTICAS=0 la elimina.
+#ifndef PROYECTO_ESTADISTICAS
+#define PROYECTO_ESTADISTICAS 1
+#endif
+
 using namespace std;
 
 /**
@@ -43,13 +90,46 @@ struct RegistroHistorial {
 };
 
 /**
- * @brief Agrupa a un estudiante con las estadisticas derivadas de sus registros de notas.
+ * @brief Vista sin copia de un registro de estudiante dentro de un archivo mapeado en memoria.
+ *
+ * Los campos de texto apuntan directamente al archivo y solo son validos mientras el mapeo exista.
  */
-struct PerfilEstudiante {
-    Estudiante estudiante;
-    vector<RegistroHistorial> historial;
-    optional<double> promedio;
-    optional<double> tasaAprobacion;
+struct VistaEstudiante {
+    string_view carne;
+    string_view genero;
+    string_view residencia;
+    int edad = 0;
+    string_view colegioProcedencia;
+    string_view tipoColegio;
+    bool trabaja = false;
+    string_view estadoCivil;
+};
+
+/**
+ * @brief Vista sin copia de un registro de historial dentro de un archivo mapeado en memoria.
+ */
+struct VistaRegistroHistorial {
+    string_view carneEstudiante;
+    int semestre = 0;
+    string_view materia;
+    double nota = 0.0;
+};
+
+/**
+ * @brief Estrategia de lectura usada por los repositorios al cargar registros.
+ */
+enum class ModoLectura {
+    Flujo,
+    Mapeado
+};
+
+/**
+ * @brief Momentos en que los repositorios piden al sistema operativo llevar sus escrituras a disco.
+ */
+enum class SincronizacionDisco {
+    Ninguna,     ///< Nunca se llama a fsync; el sistema operativo decide cuando escribir.
+    AlConfirmar, ///< Solo las confirmaciones explicitas son duraderas.
+    Siempre      ///< Tambien los volcados automaticos por tamano o tiempo son duraderos.
 };
 
 namespace fs = filesystem;
@@ -58,13 +138,28 @@ namespace {
 
 constexpr const char *kArchivoEstudiantes = "estudiantes.bin";
 constexpr const char *kArchivoHistorial = "historial.bin";
+constexpr const char *kExtensionIndice = ".idx";
+constexpr uint32_t kFirmaIndiceCarnes = 0x58444943U; // "CIDX" en little endian.
+constexpr const char *kExtensionDesplazamientos = ".ofs";
+constexpr uint32_t kFirmaEstudiantes = 0x54534543U;      // "CEST" en little endian.
+constexpr uint32_t kFirmaHistorial = 0x53494843U;        // "CHIS" en little endian.
+constexpr uint32_t kFirmaDesplazamientos = 0x53464F43U;  // "COFS" en little endian.
+constexpr uint32_t kVersionFormato = 2;
+constexpr uint32_t kVersionDesplazamientos = 3; // La version 2 de la tabla no guardaba finDatos.
+constexpr uint32_t kBanderaOrdenadoPorCarne = 1U; // Registros agrupados por carne y semestre.
+constexpr size_t kAlineacionRegistro = 8;
+constexpr size_t kCabeceraEstudiante = 36;
+constexpr size_t kCabeceraHistorial = 24;
+constexpr uint32_t kLongitudMaximaCadena = 10'000;
+constexpr size_t kBytesLoteEscritura = size_t{1} << 20;
+constexpr chrono::milliseconds kIntervaloVolcado{200};
 
 /**
  * @brief Escribe una cadena con prefijo de longitud en un flujo binario.
  * @param out Flujo de salida abierto en modo binario.
  * @param valor Cadena que se escribira.
  */
-void escribirCadena(ofstream &out, const string &valor) {
+void escribirCadena(ostream &out, const string &valor) {
     const auto longitud = static_cast<uint32_t>(valor.size());
     out.write(reinterpret_cast<const char *>(&longitud), sizeof(longitud));
     out.write(valor.data(), static_cast<streamsize>(longitud));
@@ -76,12 +171,12 @@ void escribirCadena(ofstream &out, const string &valor) {
  * @param valor Parametro de salida que recibe la cadena decodificada.
  * @return true si la cadena se leyo con exito; false en fin de archivo o error.
  */
-bool leerCadena(ifstream &in, string &valor) {
+bool leerCadena(istream &in, string &valor) {
     uint32_t longitud = 0;
     if (!in.read(reinterpret_cast<char *>(&longitud), sizeof(longitud))) {
         return false;
     }
-    if (longitud > 10'000) {
+    if (longitud > kLongitudMaximaCadena) {
         throw runtime_error("Longitud de cadena invalida encontrada en el archivo binario.");
     }
     string buffer(longitud, '\0');
@@ -95,558 +190,5663 @@ bool leerCadena(ifstream &in, string &valor) {
 }
 
 /**
- * @brief Escribe un valor booleano en un flujo binario como un unico byte.
- * @param out Flujo de salida abierto en modo binario.
- * @param valor Indicador booleano a persistir.
+ * @brief Fases del programa cuyo tiempo acumula la instrumentacion.
  */
-void escribirBooleano(ofstream &out, bool valor) {
-    uint8_t flag = valor ? 1U : 0U;
-    out.write(reinterpret_cast<const char *>(&flag), sizeof(flag));
-}
+enum class FaseMedida {
+    LecturaEstudiantes,
+    LecturaHistorial,
+    AgrupacionHistorial,
+    ConstruccionArbol,
+    FormatoSalida
+};
+constexpr size_t kCantidadFases = 5;
 
 /**
- * @brief Lee un valor booleano de un flujo binario codificado como un unico byte.
- * @param in Flujo de entrada abierto en modo binario.
- * @param valor Parametro de salida que recibe el indicador decodificado.
- * @return true si el indicador se leyo con exito; false en caso contrario.
+ * @brief Contadores de trabajo que acumula la instrumentacion.
  */
-bool leerBooleano(ifstream &in, bool &valor) {
-    uint8_t flag = 0;
-    if (!in.read(reinterpret_cast<char *>(&flag), sizeof(flag))) {
-        return false;
-    }
-    valor = flag != 0;
-    return true;
-}
+enum class ContadorMedido {
+    RegistrosDecodificados,
+    BytesLeidos,
+    CadenasCreadas,
+    NodosCreados
+};
+constexpr size_t kCantidadContadores = 4;
 
 /**
- * @brief Lee una estructura Estudiante desde el flujo.
- * @param in Flujo de entrada en modo binario.
- * @param estudiante Parametro de salida que recibe el estudiante decodificado.
- * @return true si el registro se leyo; false en fin de archivo o error.
+ * @brief Niveles de arbol con tiempo propio; los mas profundos se suman en el ultimo.
  */
-bool leerEstudiante(ifstream &in, Estudiante &estudiante) {
-    Estudiante temporal;
-    if (!leerCadena(in, temporal.carne)) {
-        return false;
-    }
-    if (!leerCadena(in, temporal.genero)) {
-        return false;
-    }
-    if (!leerCadena(in, temporal.residencia)) {
-        return false;
-    }
-    if (!in.read(reinterpret_cast<char *>(&temporal.edad), sizeof(temporal.edad))) {
-        return false;
-    }
-    if (!leerCadena(in, temporal.colegioProcedencia)) {
-        return false;
-    }
-    if (!leerCadena(in, temporal.tipoColegio)) {
-        return false;
-    }
-    if (!leerBooleano(in, temporal.trabaja)) {
-        return false;
-    }
-    if (!leerCadena(in, temporal.estadoCivil)) {
-        return false;
-    }
-    estudiante = move(temporal);
-    return true;
-}
+constexpr size_t kNivelesMedidos = 12;
 
 /**
- * @brief Escribe la estructura Estudiante en el flujo.
- * @param out Flujo de salida en modo binario.
- * @param estudiante Registro a persistir.
+ * @brief Cadenas que se crean al materializar un Estudiante o un RegistroHistorial.
  */
-void escribirEstudiante(ofstream &out, const Estudiante &estudiante) {
-    escribirCadena(out, estudiante.carne);
-    escribirCadena(out, estudiante.genero);
-    escribirCadena(out, estudiante.residencia);
-    out.write(reinterpret_cast<const char *>(&estudiante.edad), sizeof(estudiante.edad));
-    escribirCadena(out, estudiante.colegioProcedencia);
-    escribirCadena(out, estudiante.tipoColegio);
-    escribirBooleano(out, estudiante.trabaja);
-    escribirCadena(out, estudiante.estadoCivil);
-}
+constexpr size_t kCadenasPorEstudiante = 6;
+constexpr size_t kCadenasPorRegistroHistorial = 2;
 
 /**
- * @brief Lee una estructura RegistroHistorial desde el flujo.
- * @param in Flujo de entrada en modo binario.
- * @param registro Parametro de salida que recibe el registro decodificado.
- * @return true si el registro se leyo; false en caso contrario.
+ * @brief Acumuladores globales de tiempo por fase, contadores de trabajo y tiempo por nivel de
+ *        arbol.
+ *
+ * Los campos son atomicos con orden relajado: los hilos del pool suman sin sincronizarse y los
+ * totales solo se leen al generar el reporte. Los contadores se suman por bloque (archivo, tramo o
+ * nodo) y no por elemento. Las fases pueden anidarse, por lo que sus tiempos son inclusivos; el
+ * tiempo de un nivel es el de agrupar sus nodos, sin contar sus subarboles. Los nodos de un nivel
+ * son los creados en el, raiz y hojas incluidas, y suman el contador NodosCreados.
  */
-bool leerRegistroHistorial(ifstream &in, RegistroHistorial &registro) {
-    RegistroHistorial temporal;
-    if (!leerCadena(in, temporal.carneEstudiante)) {
-        return false;
-    }
-    if (!in.read(reinterpret_cast<char *>(&temporal.semestre), sizeof(temporal.semestre))) {
-        return false;
-    }
-    if (!leerCadena(in, temporal.materia)) {
-        return false;
-    }
-    if (!in.read(reinterpret_cast<char *>(&temporal.nota), sizeof(temporal.nota))) {
-        return false;
+class Estadisticas {
+public:
+    /**
+     * @brief Devuelve los acumuladores del proceso.
+     * @return Referencia a la instancia global.
+     */
+    static Estadisticas &global() {
+        static Estadisticas instancia;
+        return instancia;
     }
-    registro = move(temporal);
-    return true;
-}
-
-/**
- * @brief Escribe la estructura RegistroHistorial en el flujo.
- * @param out Flujo de salida en modo binario.
- * @param registro Registro a persistir.
- */
-void escribirRegistroHistorial(ofstream &out, const RegistroHistorial &registro) {
-    escribirCadena(out, registro.carneEstudiante);
-    out.write(reinterpret_cast<const char *>(&registro.semestre), sizeof(registro.semestre));
-    escribirCadena(out, registro.materia);
-    out.write(reinterpret_cast<const char *>(&registro.nota), sizeof(registro.nota));
-}
 
-/**
- * @brief Elimina espacios en blanco en ambos extremos de una cadena.
- * @param texto Cadena original.
- * @return Cadena sin espacios iniciales ni finales.
- */
-string recortar(const string &texto) {
-    auto inicio = texto.find_first_not_of(" \t\n\r\f\v");
-    auto fin = texto.find_last_not_of(" \t\n\r\f\v");
-    if (inicio == string::npos) {
-        return {};
+    /**
+     * @brief Suma la duracion de una ejecucion de una fase.
+     * @param fase Fase medida.
+     * @param duracion Tiempo transcurrido.
+     */
+    void sumarTiempo(FaseMedida fase, chrono::nanoseconds duracion) {
+        sumar(fases_[static_cast<size_t>(fase)], duracion);
     }
-    return texto.substr(inicio, fin - inicio + 1);
-}
-
-/**
- * @brief Convierte una cadena a mayusculas.
- * @param texto Cadena original.
- * @return Copia en mayusculas.
- */
-string aMayusculas(const string &texto) {
-    string resultado = texto;
-    transform(resultado.begin(), resultado.end(), resultado.begin(),
-                   [](unsigned char ch) { return static_cast<char>(toupper(ch)); });
-    return resultado;
-}
 
-/**
- * @brief Devuelve el tamano del archivo en bytes o cero si no existe.
- * @param ruta Ruta en el sistema de archivos.
- * @return Tamano en bytes o cero si hay fallo.
- */
-uintmax_t tamanoArchivoSeguro(const string &ruta) {
-    if (!fs::exists(ruta)) {
-        return 0U;
-    }
-    error_code ec;
-    const auto tamano = fs::file_size(ruta, ec);
-    if (ec) {
-        return 0U;
+    /**
+     * @brief Suma la duracion de la agrupacion de un nodo del nivel indicado.
+     * @param nivel Nivel del nodo agrupado (0 es la raiz).
+     * @param duracion Tiempo transcurrido.
+     */
+    void sumarNivel(size_t nivel, chrono::nanoseconds duracion) {
+        sumar(niveles_[min(nivel, kNivelesMedidos - 1)], duracion);
     }
-    return tamano;
-}
 
-} // namespace
+    /**
+     * @brief Registra nodos creados en un nivel del arbol y los suma a NodosCreados.
+     * @param nivel Nivel de los nodos (0 es la raiz).
+     * @param cantidad Cantidad de nodos.
+     */
+    void sumarNodos(size_t nivel, uint64_t cantidad) {
+        nodosNivel_[min(nivel, kNivelesMedidos - 1)].fetch_add(cantidad, memory_order_relaxed);
+        sumar(ContadorMedido::NodosCreados, cantidad);
+    }
 
-/**
- * @brief Proporciona persistencia binaria para registros de estudiantes.
- */
-class RepositorioEstudiantes {
-public:
-    explicit RepositorioEstudiantes(string ruta) : ruta_(move(ruta)) {}
+    /**
+     * @brief Incrementa un contador.
+     * @param contador Contador afectado.
+     * @param cantidad Cantidad sumada.
+     */
+    void sumar(ContadorMedido contador, uint64_t cantidad) {
+        contadores_[static_cast<size_t>(contador)].fetch_add(cantidad, memory_order_relaxed);
+    }
 
     /**
-     * @brief Carga todos los estudiantes desde el disco.
-     * @return Vector con cada estudiante persistido.
+     * @brief Pone en cero todos los acumuladores.
      */
-    vector<Estudiante> cargarTodos() const {
-        vector<Estudiante> estudiantes;
-        ifstream in(ruta_, ios::binary);
-        if (!in.is_open()) {
-            return estudiantes;
+    void reiniciar() {
+        for (auto &tiempo : fases_) {
+            tiempo.nanosegundos.store(0U, memory_order_relaxed);
+            tiempo.llamadas.store(0U, memory_order_relaxed);
         }
-        Estudiante estudiante;
-        while (leerEstudiante(in, estudiante)) {
-            estudiantes.push_back(estudiante);
+        for (auto &tiempo : niveles_) {
+            tiempo.nanosegundos.store(0U, memory_order_relaxed);
+            tiempo.llamadas.store(0U, memory_order_relaxed);
+        }
+        for (auto &contador : contadores_) {
+            contador.store(0U, memory_order_relaxed);
+        }
+        for (auto &nodos : nodosNivel_) {
+            nodos.store(0U, memory_order_relaxed);
         }
-        return estudiantes;
     }
 
     /**
-     * @brief Anade un nuevo estudiante al disco.
-     * @param estudiante Registro a persistir.
-     * @throws runtime_error cuando el identificador ya existe o no se puede abrir el archivo.
+     * @brief Escribe un resumen legible con fases, contadores y niveles.
+     * @param salida Flujo de destino.
      */
-    void agregar(const Estudiante &estudiante) const {
-        if (existe(estudiante.carne)) {
-            throw runtime_error("El carne ingresado ya esta registrado.");
+    void imprimirTabla(ostream &salida) const {
+        // Se formatea aparte para no dejar fixed ni setprecision aplicados en el flujo del llamador.
+        ostringstream texto;
+        texto << "\n=== Estadisticas de rendimiento ===\n";
+        if (!PROYECTO_ESTADISTICAS) {
+            salida << texto.str()
+                   << "La instrumentacion se desactivo al compilar (PROYECTO_ESTADISTICAS=0).\n";
+            return;
         }
-        ofstream out(ruta_, ios::binary | ios::app);
-        if (!out.is_open()) {
-            throw runtime_error("No se pudo abrir el archivo de estudiantes para escritura.");
+        texto << left << setw(28) << "Fase" << right << setw(12) << "Llamadas" << setw(16)
+              << "Tiempo (ms)" << '\n';
+        for (size_t fase = 0; fase < kCantidadFases; ++fase) {
+            texto << left << setw(28) << kNombresFases[fase] << right << setw(12)
+                  << fases_[fase].llamadas.load(memory_order_relaxed) << setw(16) << fixed
+                  << setprecision(3) << milisegundos(fases_[fase]) << '\n';
+        }
+        texto << '\n' << left << setw(28) << "Contador" << right << setw(16) << "Total" << '\n';
+        for (size_t contador = 0; contador < kCantidadContadores; ++contador) {
+            texto << left << setw(28) << kNombresContadores[contador] << right << setw(16)
+                  << contadores_[contador].load(memory_order_relaxed) << '\n';
         }
-        escribirEstudiante(out, estudiante);
+        texto << '\n' << left << setw(28) << "Nivel del arbol" << right << setw(16)
+              << "Nodos creados" << setw(18) << "Agrupacion (ms)" << '\n';
+        for (size_t nivel = 0; nivel < kNivelesMedidos; ++nivel) {
+            if (!nivelMedido(nivel)) {
+                continue;
+            }
+            texto << left << setw(28) << nivel << right << setw(16)
+                  << nodosNivel_[nivel].load(memory_order_relaxed) << setw(18) << fixed
+                  << setprecision(3) << milisegundos(niveles_[nivel]) << '\n';
+        }
+        salida << texto.str();
     }
 
     /**
-     * @brief Verifica si existe un estudiante con el identificador indicado.
-     * @param carne Carne que se desea buscar.
-     * @return true si el estudiante existe; false en caso contrario.
+     * @brief Escribe los mismos datos de imprimirTabla como un objeto JSON en una linea.
+     * @param salida Flujo de destino.
      */
-    bool existe(const string &carne) const {
-        ifstream in(ruta_, ios::binary);
-        if (!in.is_open()) {
-            return false;
+    void imprimirJson(ostream &salida) const {
+        ostringstream texto;
+        texto << "{\"habilitada\":" << (PROYECTO_ESTADISTICAS ? "true" : "false") << ",\"fases\":{";
+        for (size_t fase = 0; fase < kCantidadFases; ++fase) {
+            texto << (fase == 0 ? "" : ",") << '"' << kClavesFases[fase] << "\":{\"llamadas\":"
+                  << fases_[fase].llamadas.load(memory_order_relaxed) << ",\"ms\":" << fixed
+                  << setprecision(3) << milisegundos(fases_[fase]) << '}';
         }
-        Estudiante estudiante;
-        while (leerEstudiante(in, estudiante)) {
-            if (estudiante.carne == carne) {
-                return true;
+        texto << "},\"contadores\":{";
+        for (size_t contador = 0; contador < kCantidadContadores; ++contador) {
+            texto << (contador == 0 ? "" : ",") << '"' << kClavesContadores[contador]
+                  << "\":" << contadores_[contador].load(memory_order_relaxed);
+        }
+        texto << "},\"niveles\":[";
+        bool primero = true;
+        for (size_t nivel = 0; nivel < kNivelesMedidos; ++nivel) {
+            if (!nivelMedido(nivel)) {
+                continue;
             }
+            texto << (primero ? "" : ",") << "{\"nivel\":" << nivel << ",\"nodos\":"
+                  << nodosNivel_[nivel].load(memory_order_relaxed) << ",\"agrupados\":"
+                  << niveles_[nivel].llamadas.load(memory_order_relaxed) << ",\"ms\":" << fixed
+                  << setprecision(3) << milisegundos(niveles_[nivel]) << '}';
+            primero = false;
         }
-        return false;
+        texto << "]}\n";
+        salida << texto.str();
     }
 
+private:
+    struct TiempoAcumulado {
+        atomic<uint64_t> nanosegundos{0U};
+        atomic<uint64_t> llamadas{0U};
+    };
+
+    static constexpr array<const char *, kCantidadFases> kNombresFases = {
+        "Lectura de estudiantes", "Lectura de historial", "Agrupacion de historial",
+        "Construccion de arbol", "Formato de salida"};
+    static constexpr array<const char *, kCantidadFases> kClavesFases = {
+        "lecturaEstudiantes", "lecturaHistorial", "agrupacionHistorial", "construccionArbol",
+        "formatoSalida"};
+    static constexpr array<const char *, kCantidadContadores> kNombresContadores = {
+        "Registros decodificados", "Bytes leidos", "Cadenas creadas", "Nodos creados"};
+    static constexpr array<const char *, kCantidadContadores> kClavesContadores = {
+        "registrosDecodificados", "bytesLeidos", "cadenasCreadas", "nodosCreados"};
+
+    array<TiempoAcumulado, kCantidadFases> fases_;
+    array<TiempoAcumulado, kNivelesMedidos> niveles_;
+    array<atomic<uint64_t>, kCantidadContadores> contadores_{};
+    array<atomic<uint64_t>, kNivelesMedidos> nodosNivel_{};
+
     /**
-     * @brief Garantiza que el archivo del repositorio exista en disco.
+     * @brief Indica si un nivel tuvo nodos creados o agrupados.
+     * @param nivel Nivel consultado.
      */
-    void asegurarArchivo() const {
-        if (!fs::exists(ruta_)) {
-            ofstream out(ruta_, ios::binary);
-        }
+    [[nodiscard]] bool nivelMedido(size_t nivel) const {
+        return nodosNivel_[nivel].load(memory_order_relaxed) != 0 ||
+               niveles_[nivel].llamadas.load(memory_order_relaxed) != 0;
     }
 
     /**
-     * @brief Devuelve la ruta del archivo del repositorio.
-     * @return Referencia constante a la cadena de ruta.
+     * @brief Suma una duracion y una llamada a un acumulador.
+     * @param tiempo Acumulador afectado.
+     * @param duracion Tiempo transcurrido.
      */
-    [[nodiscard]] const string &ruta() const {
-        return ruta_;
+    static void sumar(TiempoAcumulado &tiempo, chrono::nanoseconds duracion) {
+        tiempo.nanosegundos.fetch_add(static_cast<uint64_t>(duracion.count()), memory_order_relaxed);
+        tiempo.llamadas.fetch_add(1U, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Convierte un acumulador a milisegundos.
+     * @param tiempo Acumulador leido.
+     * @return Tiempo total en milisegundos.
+     */
+    static double milisegundos(const TiempoAcumulado &tiempo) {
+        return static_cast<double>(tiempo.nanosegundos.load(memory_order_relaxed)) / 1e6;
+    }
+};
+
+/**
+ * @brief Mide el tiempo de vida de un alcance y lo suma a una fase o a un nivel del arbol.
+ */
+class CronometroMedicion {
+public:
+    explicit CronometroMedicion(FaseMedida fase) : fase_(fase) {}
+    explicit CronometroMedicion(size_t nivel) : nivel_(nivel) {}
+
+    ~CronometroMedicion() {
+        const auto duracion = chrono::steady_clock::now() - inicio_;
+        if (nivel_.has_value()) {
+            Estadisticas::global().sumarNivel(nivel_.value(), duracion);
+        } else {
+            Estadisticas::global().sumarTiempo(fase_, duracion);
+        }
     }
 
+    CronometroMedicion(const CronometroMedicion &) = delete;
+    CronometroMedicion &operator=(const CronometroMedicion &) = delete;
+
 private:
-    string ruta_;
+    FaseMedida fase_ = FaseMedida::LecturaEstudiantes;
+    optional<size_t> nivel_;
+    chrono::steady_clock::time_point inicio_ = chrono::steady_clock::now();
 };
 
+#if PROYECTO_ESTADISTICAS
+#define MEDIR_FASE(fase) const CronometroMedicion medicionFase(fase)
+#define MEDIR_NIVEL(nivel) const CronometroMedicion medicionNivel(static_cast<size_t>(nivel))
+#define CONTAR(contador, cantidad) \
+    Estadisticas::global().sumar(contador, static_cast<uint64_t>(cantidad))
+#define CONTAR_NODOS(nivel, cantidad) \
+    Estadisticas::global().sumarNodos(static_cast<size_t>(nivel), static_cast<uint64_t>(cantidad))
+#else
+#define MEDIR_FASE(fase) static_cast<void>(0)
+#define MEDIR_NIVEL(nivel) static_cast<void>(0)
+#define CONTAR(contador, cantidad) static_cast<void>(0)
+#define CONTAR_NODOS(nivel, cantidad) static_cast<void>(0)
+#endif
+
 /**
- * @brief Proporciona persistencia binaria para los registros de historial academico.
+ * @brief Bytes que acumula SalidaBufer antes de escribir un bloque en el flujo destino.
  */
-class RepositorioHistorial {
+constexpr size_t kBytesBuferSalida = size_t{1} << 20;
+
+/**
+ * @brief Numero de punto flotante que SalidaBufer escribe con una cantidad fija de decimales.
+ */
+struct DecimalFijo {
+    double valor = 0.0;
+    int decimales = 2;
+};
+
+/**
+ * @brief Bufer de salida que formatea con to_chars y escribe en bloques grandes.
+ *
+ * No usa locale ni las banderas del flujo destino: los enteros salen en base 10 y los decimales se
+ * piden con DecimalFijo. Lo acumulado se escribe al superar la capacidad, al llamar a vaciar y al
+ * destruir el bufer, por lo que el flujo destino no debe usarse directamente mientras tanto.
+ */
+class SalidaBufer {
 public:
-    explicit RepositorioHistorial(string ruta) : ruta_(move(ruta)) {}
+    /**
+     * @brief Crea un bufer vacio asociado a un flujo.
+     * @param destino Flujo donde se escriben los bloques.
+     * @param capacidad Bytes acumulados antes de escribir un bloque.
+     */
+    explicit SalidaBufer(ostream &destino, size_t capacidad = kBytesBuferSalida)
+        : destino_(destino), capacidad_(capacidad) {
+        bufer_.reserve(capacidad_);
+    }
+
+    ~SalidaBufer() {
+        vaciar();
+    }
+
+    SalidaBufer(const SalidaBufer &) = delete;
+    SalidaBufer &operator=(const SalidaBufer &) = delete;
 
     /**
-     * @brief Carga todos los registros de historial desde el disco.
-     * @return Vector con cada registro persistido.
+     * @brief Anade texto al bufer.
+     * @param texto Texto copiado.
+     * @return Referencia al bufer.
      */
-    vector<RegistroHistorial> cargarTodos() const {
-        vector<RegistroHistorial> registros;
-        ifstream in(ruta_, ios::binary);
-        if (!in.is_open()) {
-            return registros;
-        }
-        RegistroHistorial registro;
-        while (leerRegistroHistorial(in, registro)) {
-            registros.push_back(registro);
-        }
-        return registros;
+    SalidaBufer &operator<<(string_view texto) {
+        bufer_.append(texto);
+        return revisarCapacidad();
+    }
+
+    SalidaBufer &operator<<(const char *texto) {
+        return *this << string_view(texto);
+    }
+
+    SalidaBufer &operator<<(const string &texto) {
+        return *this << string_view(texto);
+    }
+
+    SalidaBufer &operator<<(char caracter) {
+        bufer_.push_back(caracter);
+        return revisarCapacidad();
     }
 
     /**
-     * @brief Anade un registro de historial al disco.
-     * @param registro Registro a persistir.
-     * @throws runtime_error cuando no se puede abrir el archivo.
+     * @brief Anade un entero en base 10.
+     * @param valor Entero con o sin signo.
+     * @return Referencia al bufer.
      */
-    void agregar(const RegistroHistorial &registro) const {
-        ofstream out(ruta_, ios::binary | ios::app);
-        if (!out.is_open()) {
-            throw runtime_error("No se pudo abrir el archivo de historial para escritura.");
-        }
-        escribirRegistroHistorial(out, registro);
+    template <typename Entero>
+    SalidaBufer &operator<<(Entero valor) {
+        static_assert(is_integral_v<Entero>, "SalidaBufer solo formatea enteros y DecimalFijo");
+        array<char, 24> digitos{};
+        const auto [fin, error] = to_chars(digitos.data(), digitos.data() + digitos.size(), valor);
+        bufer_.append(digitos.data(), fin);
+        return revisarCapacidad();
     }
 
     /**
-     * @brief Garantiza que el archivo del repositorio exista en disco.
+     * @brief Anade un numero en notacion fija con los decimales indicados.
+     * @param decimal Valor y cantidad de decimales.
+     * @return Referencia al bufer.
      */
-    void asegurarArchivo() const {
-        if (!fs::exists(ruta_)) {
-            ofstream out(ruta_, ios::binary);
+    SalidaBufer &operator<<(DecimalFijo decimal) {
+        // Alcanza para cualquier double en notacion fija con pocos decimales.
+        array<char, 400> digitos{};
+        const auto [fin, error] = to_chars(digitos.data(), digitos.data() + digitos.size(),
+                                           decimal.valor, chars_format::fixed, decimal.decimales);
+        if (error != errc()) {
+            throw runtime_error("No se pudo formatear un valor decimal.");
         }
+        bufer_.append(digitos.data(), fin);
+        return revisarCapacidad();
     }
 
     /**
-     * @brief Devuelve la ruta del archivo del repositorio.
-     * @return Referencia constante a la cadena de ruta.
+     * @brief Escribe lo acumulado en el flujo destino y deja el bufer vacio para reutilizarlo.
      */
-    [[nodiscard]] const string &ruta() const {
-        return ruta_;
+    void vaciar() {
+        if (!bufer_.empty()) {
+            destino_.write(bufer_.data(), static_cast<streamsize>(bufer_.size()));
+            bufer_.clear();
+        }
     }
 
 private:
-    string ruta_;
-};
+    ostream &destino_;
+    size_t capacidad_;
+    string bufer_;
 
-/**
- * @brief Carga perfiles de estudiantes con estadisticas desde los repositorios.
- * @param repositorioEstudiantes Repositorio que suministra los registros de estudiantes.
- * @param repositorioHistorial Repositorio que suministra los registros de historial.
- * @return Vector de perfiles de estudiantes con promedios y tasas de aprobacion calculadas.
- */
-vector<PerfilEstudiante> cargarPerfiles(const RepositorioEstudiantes &repositorioEstudiantes,
-                                        const RepositorioHistorial &repositorioHistorial) {
-    const auto estudiantes = repositorioEstudiantes.cargarTodos();
-    const auto registrosHistorial = repositorioHistorial.cargarTodos();
-
-    unordered_map<string, vector<RegistroHistorial>> registrosPorEstudiante;
-    registrosPorEstudiante.reserve(registrosHistorial.size());
-    for (const auto &registro : registrosHistorial) {
-        registrosPorEstudiante[registro.carneEstudiante].push_back(registro);
-    }
-
-    vector<PerfilEstudiante> perfiles;
-    perfiles.reserve(estudiantes.size());
-    for (const auto &estudiante : estudiantes) {
-        PerfilEstudiante perfil;
-        perfil.estudiante = estudiante;
-        if (auto it = registrosPorEstudiante.find(estudiante.carne); it != registrosPorEstudiante.end()) {
-            perfil.historial = move(it->second);
-            if (!perfil.historial.empty()) {
-                double suma = 0.0;
-                size_t aprobadas = 0;
-                for (const auto &entrada : perfil.historial) {
-                    suma += entrada.nota;
-                    if (entrada.nota >= 70.0) {
-                        ++aprobadas;
-                    }
-                }
-                perfil.promedio = suma / static_cast<double>(perfil.historial.size());
-                perfil.tasaAprobacion =
-                    static_cast<double>(aprobadas) / static_cast<double>(perfil.historial.size());
-            }
+    /**
+     * @brief Escribe un bloque si el bufer alcanzo su capacidad.
+     * @return Referencia al bufer.
+     */
+    SalidaBufer &revisarCapacidad() {
+        if (bufer_.size() >= capacidad_) {
+            vaciar();
         }
-        perfiles.push_back(move(perfil));
+        return *this;
     }
-    return perfiles;
-}
+};
 
 /**
- * @brief Enumeracion de las variables de clasificacion disponibles.
+ * @brief Tramo de un listado que se imprime: omite los primeros desde elementos y muestra a lo sumo
+ *        limite.
  */
-enum class VariableClasificacion {
-    Genero = 0,
-    Residencia,
-    TipoColegio,
-    RangoEdad,
-    RangoPromedio,
-    RangoAprobacion,
-    Trabaja,
-    EstadoCivil,
-    ColegioProcedencia
+struct RangoListado {
+    size_t desde = 0;
+    size_t limite = numeric_limits<size_t>::max();
+
+    /**
+     * @brief Acota el tramo a un listado de tamano conocido.
+     * @param total Cantidad de elementos del listado.
+     * @return Par [inicio, fin) de posiciones a imprimir.
+     */
+    [[nodiscard]] pair<size_t, size_t> acotar(size_t total) const {
+        const auto inicio = min(desde, total);
+        return {inicio, inicio + min(limite, total - inicio)};
+    }
 };
 
 /**
- * @brief Devuelve el nombre legible de una variable de clasificacion.
- * @param variable Variable que se desea describir.
- * @return Nombre descriptivo para mostrar.
+ * @brief Indica, al pie de un listado, que parte se mostro cuando no se mostro completo.
+ * @param salida Bufer de salida.
+ * @param inicio Primera posicion mostrada.
+ * @param fin Posicion siguiente a la ultima mostrada.
+ * @param total Cantidad de elementos del listado.
  */
-string variableComoCadena(VariableClasificacion variable) {
-    switch (variable) {
-        case VariableClasificacion::Genero:
-            return "Genero";
-        case VariableClasificacion::Residencia:
-            return "Lugar de residencia";
-        case VariableClasificacion::TipoColegio:
-            return "Tipo de colegio";
-        case VariableClasificacion::RangoEdad:
+void imprimirPieRango(SalidaBufer &salida, size_t inicio, size_t fin, size_t total) {
+    if (fin - inicio == total) {
+        return;
+    }
+    if (inicio == fin) {
+        salida << "(Ningun elemento en el tramo pedido; el listado tiene " << total << ")\n";
+        return;
+    }
+    salida << "(Mostrando " << inicio + 1 << " a " << fin << " de " << total << ")\n";
+}
+
+/**
+ * @brief Anade un campo CSV a una cadena, entre comillas y con "" como comilla literal cuando hace
+ *        falta.
+ * @param destino Cadena a la que se anade el campo.
+ * @param campo Texto del campo.
+ */
+void anexarCampoCsv(string &destino, string_view campo) {
+    if (campo.find_first_of(",\"\r\n") == string_view::npos) {
+        destino.append(campo);
+        return;
+    }
+    destino.push_back('"');
+    for (const auto caracter : campo) {
+        if (caracter == '"') {
+            destino.push_back('"');
+        }
+        destino.push_back(caracter);
+    }
+    destino.push_back('"');
+}
+
+/**
+ * @brief Anade texto a una cadena escapando comillas, barras y controles para JSON, sin las
+ *        comillas externas.
+ * @param destino Cadena a la que se anade el texto.
+ * @param texto Texto original.
+ */
+void anexarEscapadoJson(string &destino, string_view texto) {
+    static constexpr string_view kHexadecimal = "0123456789abcdef";
+    for (const auto caracter : texto) {
+        const auto codigo = static_cast<unsigned char>(caracter);
+        if (caracter == '"' || caracter == '\\') {
+            destino.push_back('\\');
+            destino.push_back(caracter);
+        } else if (codigo < 0x20U) {
+            destino.append("\\u00");
+            destino.push_back(kHexadecimal[codigo >> 4U]);
+            destino.push_back(kHexadecimal[codigo & 0xFU]);
+        } else {
+            destino.push_back(caracter);
+        }
+    }
+}
+
+/**
+ * @brief Region de solo lectura con el contenido completo de un archivo.
+ *
+ * En sistemas POSIX el archivo se proyecta con mmap; en el resto se lee en un unico bloque. Un
+ * archivo inexistente o vacio produce una region vacia.
+ */
+class ArchivoMapeado {
+public:
+    explicit ArchivoMapeado(const string &ruta) {
+#if PROYECTO_USA_MMAP
+        const int descriptor = ::open(ruta.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return;
+        }
+        struct stat informacion {};
+        if (::fstat(descriptor, &informacion) == 0 && informacion.st_size > 0) {
+            const auto tamano = static_cast<size_t>(informacion.st_size);
+            void *region = ::mmap(nullptr, tamano, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (region != MAP_FAILED) {
+                ::madvise(region, tamano, MADV_SEQUENTIAL);
+                datos_ = static_cast<const char *>(region);
+                tamano_ = tamano;
+            }
+        }
+        ::close(descriptor);
+#else
+        ifstream in(ruta, ios::binary | ios::ate);
+        if (!in.is_open()) {
+            return;
+        }
+        const auto tamano = static_cast<streamsize>(in.tellg());
+        if (tamano <= 0) {
+            return;
+        }
+        respaldo_.resize(static_cast<size_t>(tamano));
+        in.seekg(0);
+        if (in.read(respaldo_.data(), tamano)) {
+            datos_ = respaldo_.data();
+            tamano_ = respaldo_.size();
+        }
+#endif
+    }
+
+    ~ArchivoMapeado() {
+#if PROYECTO_USA_MMAP
+        if (datos_ != nullptr) {
+            ::munmap(const_cast<char *>(datos_), tamano_);
+        }
+#endif
+    }
+
+    ArchivoMapeado(const ArchivoMapeado &) = delete;
+    ArchivoMapeado &operator=(const ArchivoMapeado &) = delete;
+
+    /**
+     * @brief Devuelve el contenido completo del archivo.
+     * @return Vista sobre los bytes mapeados.
+     */
+    [[nodiscard]] string_view contenido() const {
+        return {datos_ == nullptr ? "" : datos_, tamano_};
+    }
+
+private:
+    const char *datos_ = nullptr;
+    size_t tamano_ = 0;
+#if !PROYECTO_USA_MMAP
+    vector<char> respaldo_;
+#endif
+};
+
+/**
+ * @brief Cursor que decodifica valores con el formato binario de los repositorios sobre un bloque
+ *        de memoria, sin copiar las cadenas.
+ */
+class LectorBinario {
+public:
+    explicit LectorBinario(string_view bloque)
+        : actual_(bloque.data()), fin_(bloque.data() + bloque.size()) {}
+
+    /**
+     * @brief Indica si quedan bytes por decodificar.
+     * @return true si el cursor no ha llegado al final.
+     */
+    [[nodiscard]] bool quedanDatos() const {
+        return actual_ < fin_;
+    }
+
+    /**
+     * @brief Lee un valor trivial copiando sus bytes (admite datos sin alinear).
+     * @param valor Parametro de salida que recibe el valor.
+     * @return true si habia bytes suficientes; false en caso contrario.
+     */
+    template <typename T>
+    bool leerValor(T &valor) {
+        if (static_cast<size_t>(fin_ - actual_) < sizeof(T)) {
+            return false;
+        }
+        memcpy(&valor, actual_, sizeof(T));
+        actual_ += sizeof(T);
+        return true;
+    }
+
+    /**
+     * @brief Lee una cadena con prefijo de longitud como vista sobre el bloque.
+     * @param valor Parametro de salida que recibe la vista.
+     * @return true si la cadena estaba completa; false en caso contrario.
+     */
+    bool leerCadena(string_view &valor) {
+        uint32_t longitud = 0;
+        if (!leerValor(longitud)) {
+            return false;
+        }
+        if (longitud > kLongitudMaximaCadena) {
+            throw runtime_error("Longitud de cadena invalida encontrada en el archivo binario.");
+        }
+        if (static_cast<size_t>(fin_ - actual_) < longitud) {
+            return false;
+        }
+        valor = string_view(actual_, longitud);
+        actual_ += longitud;
+        return true;
+    }
+
+private:
+    const char *actual_;
+    const char *fin_;
+};
+
+/**
+ * @brief Decodifica un registro de estudiante del formato 1 (sin encabezado) como vista.
+ *
+ * Solo se usa para migrar archivos antiguos al formato actual.
+ * @param lector Cursor posicionado al inicio del registro.
+ * @param vista Parametro de salida que recibe la vista.
+ * @return true si el registro estaba completo; false en caso contrario.
+ */
+bool leerVistaEstudianteV1(LectorBinario &lector, VistaEstudiante &vista) {
+    uint8_t trabaja = 0;
+    if (!lector.leerCadena(vista.carne) || !lector.leerCadena(vista.genero) ||
+        !lector.leerCadena(vista.residencia) || !lector.leerValor(vista.edad) ||
+        !lector.leerCadena(vista.colegioProcedencia) || !lector.leerCadena(vista.tipoColegio) ||
+        !lector.leerValor(trabaja) || !lector.leerCadena(vista.estadoCivil)) {
+        return false;
+    }
+    vista.trabaja = trabaja != 0;
+    return true;
+}
+
+/**
+ * @brief Decodifica un registro de historial del formato 1 (sin encabezado) como vista.
+ *
+ * Solo se usa para migrar archivos antiguos al formato actual.
+ * @param lector Cursor posicionado al inicio del registro.
+ * @param vista Parametro de salida que recibe la vista.
+ * @return true si el registro estaba completo; false en caso contrario.
+ */
+bool leerVistaRegistroHistorialV1(LectorBinario &lector, VistaRegistroHistorial &vista) {
+    return lector.leerCadena(vista.carneEstudiante) && lector.leerValor(vista.semestre) &&
+           lector.leerCadena(vista.materia) && lector.leerValor(vista.nota);
+}
+
+/**
+ * @brief Materializa una vista de estudiante en un registro con cadenas propias.
+ * @param vista Vista decodificada.
+ * @return Estudiante equivalente.
+ */
+Estudiante aEstudiante(const VistaEstudiante &vista) {
+    Estudiante estudiante;
+    estudiante.carne = vista.carne;
+    estudiante.genero = vista.genero;
+    estudiante.residencia = vista.residencia;
+    estudiante.edad = vista.edad;
+    estudiante.colegioProcedencia = vista.colegioProcedencia;
+    estudiante.tipoColegio = vista.tipoColegio;
+    estudiante.trabaja = vista.trabaja;
+    estudiante.estadoCivil = vista.estadoCivil;
+    return estudiante;
+}
+
+/**
+ * @brief Materializa una vista de historial en un registro con cadenas propias.
+ * @param vista Vista decodificada.
+ * @return Registro equivalente.
+ */
+RegistroHistorial aRegistroHistorial(const VistaRegistroHistorial &vista) {
+    RegistroHistorial registro;
+    registro.carneEstudiante = vista.carneEstudiante;
+    registro.semestre = vista.semestre;
+    registro.materia = vista.materia;
+    registro.nota = vista.nota;
+    return registro;
+}
+
+/**
+ * @brief Copia los bytes de un valor trivial en una posicion de un bloque.
+ * @param destino Posicion de escritura.
+ * @param valor Valor a copiar.
+ */
+template <typename T>
+void copiarValor(char *destino, const T &valor) {
+    memcpy(destino, &valor, sizeof(T));
+}
+
+/**
+ * @brief Lee un valor trivial desde una posicion de un bloque.
+ * @param origen Posicion de lectura.
+ * @return Valor leido.
+ */
+template <typename T>
+T extraerValor(const char *origen) {
+    T valor{};
+    memcpy(&valor, origen, sizeof(T));
+    return valor;
+}
+
+/**
+ * @brief Redondea un tamano al siguiente multiplo de kAlineacionRegistro.
+ * @param tamano Tamano en bytes.
+ * @return Tamano alineado.
+ */
+size_t alinearRegistro(size_t tamano) {
+    return (tamano + kAlineacionRegistro - 1) / kAlineacionRegistro * kAlineacionRegistro;
+}
+
+/**
+ * @brief Anade un registro de longitud fija seguido de sus cadenas, rellenado hasta alinear.
+ * @param destino Bloque al que se anade el registro.
+ * @param cabecera Bytes de la parte fija; los primeros 4 reciben el tamano total.
+ * @param cadenas Cadenas del registro; sus longitudes deben estar ya en la cabecera.
+ */
+template <size_t Cantidad>
+void anexarRegistro(string &destino, string_view cabecera, const array<string_view, Cantidad> &cadenas) {
+    auto tamano = cabecera.size();
+    for (const auto cadena : cadenas) {
+        tamano += cadena.size();
+    }
+    tamano = alinearRegistro(tamano);
+    const auto inicio = destino.size();
+    destino.resize(inicio + tamano, '\0');
+    auto *registro = destino.data() + inicio;
+    memcpy(registro, cabecera.data(), cabecera.size());
+    copiarValor(registro, static_cast<uint32_t>(tamano));
+    auto *cursor = registro + cabecera.size();
+    for (const auto cadena : cadenas) {
+        memcpy(cursor, cadena.data(), cadena.size());
+        cursor += cadena.size();
+    }
+}
+
+/**
+ * @brief Codifica un estudiante (o una vista) con el formato 2 al final de un bloque.
+ *
+ * Disposicion: tamano (u32), edad (i32), trabaja (u8 y 3 de relleno), seis longitudes (u32) y las
+ * cadenas; el registro se rellena hasta un multiplo de 8 bytes.
+ * @param destino Bloque al que se anade el registro.
+ * @param estudiante Estudiante o VistaEstudiante a codificar.
+ */
+template <typename Registro>
+void escribirEstudiante(string &destino, const Registro &estudiante) {
+    const array<string_view, 6> cadenas = {estudiante.carne, estudiante.genero,
+                                           estudiante.residencia, estudiante.colegioProcedencia,
+                                           estudiante.tipoColegio, estudiante.estadoCivil};
+    array<char, kCabeceraEstudiante> cabecera{};
+    copiarValor(cabecera.data() + 4, static_cast<int32_t>(estudiante.edad));
+    cabecera[8] = estudiante.trabaja ? 1 : 0;
+    for (size_t i = 0; i < cadenas.size(); ++i) {
+        copiarValor(cabecera.data() + 12 + 4 * i, static_cast<uint32_t>(cadenas[i].size()));
+    }
+    anexarRegistro(destino, string_view(cabecera.data(), cabecera.size()), cadenas);
+}
+
+/**
+ * @brief Codifica un registro de historial (o una vista) con el formato 2 al final de un bloque.
+ *
+ * Disposicion: tamano (u32), semestre (i32), nota (f64 alineado a 8), dos longitudes (u32) y las
+ * cadenas; el registro se rellena hasta un multiplo de 8 bytes.
+ * @param destino Bloque al que se anade el registro.
+ * @param registro RegistroHistorial o VistaRegistroHistorial a codificar.
+ */
+template <typename Registro>
+void escribirRegistroHistorial(string &destino, const Registro &registro) {
+    const array<string_view, 2> cadenas = {registro.carneEstudiante, registro.materia};
+    array<char, kCabeceraHistorial> cabecera{};
+    copiarValor(cabecera.data() + 4, static_cast<int32_t>(registro.semestre));
+    copiarValor(cabecera.data() + 8, registro.nota);
+    copiarValor(cabecera.data() + 16, static_cast<uint32_t>(cadenas[0].size()));
+    copiarValor(cabecera.data() + 20, static_cast<uint32_t>(cadenas[1].size()));
+    anexarRegistro(destino, string_view(cabecera.data(), cabecera.size()), cadenas);
+}
+
+/**
+ * @brief Ubica las cadenas de un registro de formato 2 a partir de las longitudes de su cabecera.
+ * @param registro Bytes completos del registro.
+ * @param cabecera Tamano de la parte fija.
+ * @param longitudes Posicion de la primera longitud dentro de la cabecera.
+ * @param cadenas Parametro de salida con una vista por cadena.
+ * @return false si el registro es mas corto de lo que indican sus longitudes.
+ */
+template <size_t Cantidad>
+bool ubicarCadenas(string_view registro, size_t cabecera, size_t longitudes,
+                   array<string_view, Cantidad> &cadenas) {
+    if (registro.size() < cabecera) {
+        return false;
+    }
+    auto posicion = cabecera;
+    for (size_t i = 0; i < Cantidad; ++i) {
+        const auto longitud = extraerValor<uint32_t>(registro.data() + longitudes + 4 * i);
+        if (longitud > kLongitudMaximaCadena) {
+            throw runtime_error("Longitud de cadena invalida encontrada en el archivo binario.");
+        }
+        if (registro.size() - posicion < longitud) {
+            return false;
+        }
+        cadenas[i] = registro.substr(posicion, longitud);
+        posicion += longitud;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodifica un registro de estudiante de formato 2 como vista sin copia.
+ * @param registro Bytes completos del registro.
+ * @param vista Parametro de salida que recibe la vista.
+ * @return true si el registro estaba completo; false en caso contrario.
+ */
+bool leerVistaEstudiante(string_view registro, VistaEstudiante &vista) {
+    array<string_view, 6> cadenas;
+    if (!ubicarCadenas(registro, kCabeceraEstudiante, 12, cadenas)) {
+        return false;
+    }
+    vista.carne = cadenas[0];
+    vista.genero = cadenas[1];
+    vista.residencia = cadenas[2];
+    vista.colegioProcedencia = cadenas[3];
+    vista.tipoColegio = cadenas[4];
+    vista.estadoCivil = cadenas[5];
+    vista.edad = extraerValor<int32_t>(registro.data() + 4);
+    vista.trabaja = registro[8] != 0;
+    return true;
+}
+
+/**
+ * @brief Decodifica un registro de historial de formato 2 como vista sin copia.
+ * @param registro Bytes completos del registro.
+ * @param vista Parametro de salida que recibe la vista.
+ * @return true si el registro estaba completo; false en caso contrario.
+ */
+bool leerVistaRegistroHistorial(string_view registro, VistaRegistroHistorial &vista) {
+    array<string_view, 2> cadenas;
+    if (!ubicarCadenas(registro, kCabeceraHistorial, 16, cadenas)) {
+        return false;
+    }
+    vista.carneEstudiante = cadenas[0];
+    vista.materia = cadenas[1];
+    vista.semestre = extraerValor<int32_t>(registro.data() + 4);
+    vista.nota = extraerValor<double>(registro.data() + 8);
+    return true;
+}
+
+/**
+ * @brief Lee desde un flujo los bytes del siguiente registro de formato 2.
+ * @param in Flujo posicionado al inicio de un registro.
+ * @param registro Parametro de salida con los bytes del registro.
+ * @return true si el registro se leyo completo; false en fin de archivo o error.
+ */
+bool leerBytesRegistro(istream &in, string &registro) {
+    uint32_t tamano = 0;
+    if (!in.read(reinterpret_cast<char *>(&tamano), sizeof(tamano)) || tamano < sizeof(tamano) ||
+        tamano % kAlineacionRegistro != 0) {
+        return false;
+    }
+    registro.resize(tamano);
+    copiarValor(registro.data(), tamano);
+    return static_cast<bool>(
+        in.read(registro.data() + sizeof(tamano), static_cast<streamsize>(tamano - sizeof(tamano))));
+}
+
+/**
+ * @brief Lee un estudiante de formato 2 desde el flujo.
+ * @param in Flujo de entrada en modo binario.
+ * @param estudiante Parametro de salida que recibe el estudiante decodificado.
+ * @return true si el registro se leyo; false en fin de archivo o error.
+ */
+bool leerEstudiante(istream &in, Estudiante &estudiante) {
+    string registro;
+    VistaEstudiante vista;
+    if (!leerBytesRegistro(in, registro) || !leerVistaEstudiante(registro, vista)) {
+        return false;
+    }
+    estudiante = aEstudiante(vista);
+    return true;
+}
+
+/**
+ * @brief Lee un registro de historial de formato 2 desde el flujo.
+ * @param in Flujo de entrada en modo binario.
+ * @param registro Parametro de salida que recibe el registro decodificado.
+ * @return true si el registro se leyo; false en caso contrario.
+ */
+bool leerRegistroHistorial(istream &in, RegistroHistorial &registro) {
+    string bytes;
+    VistaRegistroHistorial vista;
+    if (!leerBytesRegistro(in, bytes) || !leerVistaRegistroHistorial(bytes, vista)) {
+        return false;
+    }
+    registro = aRegistroHistorial(vista);
+    return true;
+}
+
+/**
+ * @brief Elimina espacios en blanco en ambos extremos de una cadena.
+ * @param texto Cadena original.
+ * @return Cadena sin espacios iniciales ni finales.
+ */
+string recortar(const string &texto) {
+    auto inicio = texto.find_first_not_of(" \t\n\r\f\v");
+    auto fin = texto.find_last_not_of(" \t\n\r\f\v");
+    if (inicio == string::npos) {
+        return {};
+    }
+    return texto.substr(inicio, fin - inicio + 1);
+}
+
+/**
+ * @brief Convierte una cadena a mayusculas.
+ * @param texto Cadena original.
+ * @return Copia en mayusculas.
+ */
+string aMayusculas(const string &texto) {
+    string resultado = texto;
+    transform(resultado.begin(), resultado.end(), resultado.begin(),
+                   [](unsigned char ch) { return static_cast<char>(toupper(ch)); });
+    return resultado;
+}
+
+/**
+ * @brief Devuelve el tamano del archivo en bytes o cero si no existe.
+ * @param ruta Ruta en el sistema de archivos.
+ * @return Tamano en bytes o cero si hay fallo.
+ */
+uintmax_t tamanoArchivoSeguro(const string &ruta) {
+    if (!fs::exists(ruta)) {
+        return 0U;
+    }
+    error_code ec;
+    const auto tamano = fs::file_size(ruta, ec);
+    if (ec) {
+        return 0U;
+    }
+    return tamano;
+}
+
+/**
+ * @brief Divide una linea CSV en campos; admite campos entre comillas con "" como comilla literal.
+ * @param linea Linea sin el salto final.
+ * @param campos Parametro de salida; se reutiliza para evitar reservas en cada linea.
+ * @return false si una comilla queda sin cerrar.
+ */
+bool dividirCamposCsv(string_view linea, vector<string> &campos) {
+    campos.clear();
+    size_t posicion = 0;
+    while (true) {
+        auto &campo = campos.emplace_back();
+        if (posicion < linea.size() && linea[posicion] == '"') {
+            ++posicion;
+            while (true) {
+                const auto comilla = linea.find('"', posicion);
+                if (comilla == string_view::npos) {
+                    return false;
+                }
+                campo.append(linea.substr(posicion, comilla - posicion));
+                posicion = comilla + 1;
+                if (posicion < linea.size() && linea[posicion] == '"') {
+                    campo.push_back('"');
+                    ++posicion;
+                    continue;
+                }
+                break;
+            }
+            const auto coma = linea.find(',', posicion);
+            posicion = coma == string_view::npos ? linea.size() : coma;
+        } else {
+            const auto coma = linea.find(',', posicion);
+            const auto fin = coma == string_view::npos ? linea.size() : coma;
+            campo.assign(linea.substr(posicion, fin - posicion));
+            campo = recortar(campo);
+            posicion = fin;
+        }
+        if (posicion >= linea.size()) {
+            return true;
+        }
+        ++posicion;
+    }
+}
+
+/**
+ * @brief Convierte un campo de texto en numero.
+ * @param texto Campo recortado.
+ * @param valor Parametro de salida.
+ * @return true si todo el campo es un numero valido.
+ */
+template <typename Numero>
+bool convertirNumero(const string &texto, Numero &valor) {
+    const auto *fin = texto.data() + texto.size();
+    const auto [ultimo, error] = from_chars(texto.data(), fin, valor);
+    return error == errc() && ultimo == fin;
+}
+
+} // namespace
+
+/**
+ * @brief Pool de hilos con robo de trabajo.
+ *
+ * Cada hilo tiene su propia cola: las tareas encoladas desde un hilo del pool van a su cola y se
+ * toman en orden LIFO, mientras que los hilos ociosos roban desde el frente de las colas ajenas.
+ * El hilo que llama a esperar tambien ejecuta tareas hasta que no quede ninguna pendiente.
+ */
+class PoolTrabajo {
+public:
+    explicit PoolTrabajo(size_t hilos = max<size_t>(1U, thread::hardware_concurrency()))
+        : colas_(max<size_t>(1U, hilos)) {
+        for (size_t indice = 0; indice < colas_.size(); ++indice) {
+            hilos_.emplace_back([this, indice] { ciclo(indice); });
+        }
+    }
+
+    ~PoolTrabajo() {
+        {
+            lock_guard<mutex> bloqueo(mutexEspera_);
+            detener_ = true;
+        }
+        hayTrabajo_.notify_all();
+        for (auto &hilo : hilos_) {
+            hilo.join();
+        }
+    }
+
+    PoolTrabajo(const PoolTrabajo &) = delete;
+    PoolTrabajo &operator=(const PoolTrabajo &) = delete;
+
+    /**
+     * @brief Devuelve la cantidad de hilos trabajadores.
+     * @return Numero de hilos del pool.
+     */
+    [[nodiscard]] size_t hilos() const {
+        return colas_.size();
+    }
+
+    /**
+     * @brief Encola una tarea; puede invocarse desde dentro de otra tarea.
+     * @param tarea Funcion a ejecutar.
+     */
+    void encolar(function<void()> tarea) {
+        pendientes_.fetch_add(1U);
+        const auto destino =
+            (poolActual_ == this) ? indiceActual_ : siguienteCola_.fetch_add(1U) % colas_.size();
+        {
+            lock_guard<mutex> bloqueo(colas_[destino].cerrojo);
+            colas_[destino].tareas.push_back(move(tarea));
+        }
+        enCola_.fetch_add(1U);
+        {
+            lock_guard<mutex> bloqueo(mutexEspera_);
+        }
+        hayTrabajo_.notify_one();
+    }
+
+    /**
+     * @brief Bloquea hasta que terminen todas las tareas encoladas, incluidas las que estas generen,
+     *        colaborando en su ejecucion. No debe llamarse desde una tarea del pool.
+     * @throws La primera excepcion lanzada por alguna tarea.
+     */
+    void esperar() {
+        while (pendientes_.load() > 0) {
+            if (!ejecutarUna(0)) {
+                unique_lock<mutex> bloqueo(mutexEspera_);
+                terminoTarea_.wait_for(bloqueo, chrono::milliseconds(1),
+                                       [this] { return pendientes_.load() == 0 || enCola_.load() > 0; });
+            }
+        }
+        if (excepcion_) {
+            auto excepcion = exchange(excepcion_, nullptr);
+            rethrow_exception(excepcion);
+        }
+    }
+
+private:
+    struct ColaTareas {
+        mutex cerrojo;
+        deque<function<void()>> tareas;
+    };
+
+    vector<ColaTareas> colas_;
+    vector<thread> hilos_;
+    mutex mutexEspera_;
+    condition_variable hayTrabajo_;
+    condition_variable terminoTarea_;
+    atomic<size_t> pendientes_{0U};
+    atomic<size_t> enCola_{0U};
+    atomic<size_t> siguienteCola_{0U};
+    exception_ptr excepcion_;
+    bool detener_ = false;
+
+    static inline thread_local PoolTrabajo *poolActual_ = nullptr;
+    static inline thread_local size_t indiceActual_ = 0;
+
+    /**
+     * @brief Bucle de cada hilo trabajador.
+     * @param indice Cola propia del hilo.
+     */
+    void ciclo(size_t indice) {
+        poolActual_ = this;
+        indiceActual_ = indice;
+        while (true) {
+            if (ejecutarUna(indice)) {
+                continue;
+            }
+            unique_lock<mutex> bloqueo(mutexEspera_);
+            hayTrabajo_.wait(bloqueo, [this] { return detener_ || enCola_.load() > 0; });
+            if (detener_ && enCola_.load() == 0) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Toma una tarea de la cola propia (por el final) o roba una ajena (por el frente).
+     * @param propia Indice de la cola preferida.
+     * @return true si se ejecuto una tarea; false si todas las colas estaban vacias.
+     */
+    bool ejecutarUna(size_t propia) {
+        function<void()> tarea;
+        for (size_t desplazamiento = 0; desplazamiento < colas_.size() && !tarea; ++desplazamiento) {
+            auto &cola = colas_[(propia + desplazamiento) % colas_.size()];
+            lock_guard<mutex> bloqueo(cola.cerrojo);
+            if (cola.tareas.empty()) {
+                continue;
+            }
+            if (desplazamiento == 0) {
+                tarea = move(cola.tareas.back());
+                cola.tareas.pop_back();
+            } else {
+                tarea = move(cola.tareas.front());
+                cola.tareas.pop_front();
+            }
+        }
+        if (!tarea) {
+            return false;
+        }
+        enCola_.fetch_sub(1U);
+        try {
+            tarea();
+        } catch (...) {
+            lock_guard<mutex> bloqueo(mutexEspera_);
+            if (!excepcion_) {
+                excepcion_ = current_exception();
+            }
+        }
+        if (pendientes_.fetch_sub(1U) == 1U) {
+            lock_guard<mutex> bloqueo(mutexEspera_);
+            terminoTarea_.notify_all();
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief Divide [0, total) en un tramo por hilo y los procesa en el pool, o en serie.
+ * @param pool Pool de hilos.
+ * @param paralelo Si es false el rango completo se procesa en el hilo actual.
+ * @param total Tamano del rango.
+ * @param procesar Funcion invocada como procesar(inicio, fin).
+ */
+template <typename Proceso>
+void repartirRango(PoolTrabajo &pool, bool paralelo, size_t total, Proceso &&procesar) {
+    if (!paralelo || total < 2) {
+        procesar(size_t{0}, total);
+        return;
+    }
+    const auto tramos = min(pool.hilos(), total);
+    for (size_t tramo = 0; tramo < tramos; ++tramo) {
+        pool.encolar([&procesar, total, tramos, tramo] {
+            procesar(total * tramo / tramos, total * (tramo + 1) / tramos);
+        });
+    }
+    pool.esperar();
+}
+
+constexpr array<string_view, 8> kColumnasCsvEstudiantes = {
+    "carne", "genero", "residencia", "edad", "colegio", "tipoColegio", "trabaja", "estadoCivil"};
+constexpr array<string_view, 4> kColumnasCsvHistorial = {"carne", "semestre", "materia", "nota"};
+constexpr string_view kMarcaOrdenBytes = "\xEF\xBB\xBF";
+
+/**
+ * @brief Indica si una linea CSV es el encabezado con las columnas esperadas.
+ * @param linea Primera linea del archivo, sin salto de linea.
+ * @param columnas Nombres esperados, en orden; se comparan sin distinguir mayusculas.
+ * @return true si la linea tiene exactamente esas columnas.
+ */
+bool esEncabezadoCsv(string_view linea, span<const string_view> columnas) {
+    vector<string> campos;
+    if (!dividirCamposCsv(linea, campos) || campos.size() != columnas.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < columnas.size(); ++i) {
+        if (aMayusculas(recortar(campos[i])) != aMayusculas(string(columnas[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Analiza un archivo CSV repartiendo bloques de lineas completas entre los hilos del pool.
+ *
+ * Se descarta una marca de orden de bytes UTF-8 inicial. La primera linea se trata como encabezado
+ * solo si coincide completa con las columnas esperadas; cualquier otra se analiza como datos. Las
+ * lineas vacias se ignoran. Los registros se devuelven en el orden del archivo.
+ * @param contenido Texto completo del archivo.
+ * @param columnas Nombres de las columnas del encabezado opcional.
+ * @param pool Pool de hilos.
+ * @param convertir Funcion convertir(campos) que devuelve un registro o lanza runtime_error.
+ * @return Registros convertidos.
+ * @throws runtime_error con el numero de la primera linea invalida.
+ */
+template <typename Registro, typename Conversion>
+vector<Registro> analizarCsvParalelo(string_view contenido, span<const string_view> columnas,
+                                     PoolTrabajo &pool, Conversion &&convertir) {
+    if (contenido.starts_with(kMarcaOrdenBytes)) {
+        contenido.remove_prefix(kMarcaOrdenBytes.size());
+    }
+    size_t lineasOmitidas = 0;
+    const auto primerSalto = contenido.find('\n');
+    auto primeraLinea = contenido.substr(0, primerSalto);
+    if (!primeraLinea.empty() && primeraLinea.back() == '\r') {
+        primeraLinea.remove_suffix(1);
+    }
+    if (esEncabezadoCsv(primeraLinea, columnas)) {
+        contenido = primerSalto == string_view::npos ? string_view() : contenido.substr(primerSalto + 1);
+        lineasOmitidas = 1;
+    }
+    const auto bloques = max<size_t>(1U, min(pool.hilos(), contenido.size() / 65536));
+    vector<size_t> cortes = {0};
+    for (size_t bloque = 1; bloque < bloques; ++bloque) {
+        const auto salto = contenido.find('\n', max(cortes.back(), contenido.size() * bloque / bloques));
+        cortes.push_back(salto == string_view::npos ? contenido.size() : salto + 1);
+    }
+    cortes.push_back(contenido.size());
+
+    struct Parcial {
+        vector<Registro> registros;
+        size_t lineas = 0;
+        optional<string> error;
+    };
+    vector<Parcial> parciales(bloques);
+    repartirRango(pool, bloques > 1, bloques, [&](size_t inicio, size_t fin) {
+        vector<string> campos;
+        for (auto bloque = inicio; bloque < fin; ++bloque) {
+            auto &parcial = parciales[bloque];
+            auto resto = contenido.substr(cortes[bloque], cortes[bloque + 1] - cortes[bloque]);
+            while (!resto.empty() && !parcial.error.has_value()) {
+                const auto salto = resto.find('\n');
+                auto linea = resto.substr(0, salto);
+                resto = salto == string_view::npos ? string_view() : resto.substr(salto + 1);
+                ++parcial.lineas;
+                if (!linea.empty() && linea.back() == '\r') {
+                    linea.remove_suffix(1);
+                }
+                if (linea.find_first_not_of(" \t") == string_view::npos) {
+                    continue;
+                }
+                try {
+                    if (!dividirCamposCsv(linea, campos)) {
+                        throw runtime_error("comilla sin cerrar");
+                    }
+                    parcial.registros.push_back(convertir(campos));
+                } catch (const exception &ex) {
+                    parcial.error = ex.what();
+                }
+            }
+        }
+    });
+
+    vector<Registro> registros;
+    size_t lineasPrevias = lineasOmitidas;
+    size_t total = 0;
+    for (const auto &parcial : parciales) {
+        if (parcial.error.has_value()) {
+            throw runtime_error("Linea " + to_string(lineasPrevias + parcial.lineas) + ": " +
+                                parcial.error.value());
+        }
+        lineasPrevias += parcial.lineas;
+        total += parcial.registros.size();
+    }
+    registros.reserve(total);
+    for (auto &parcial : parciales) {
+        move(parcial.registros.begin(), parcial.registros.end(), back_inserter(registros));
+    }
+    return registros;
+}
+
+/**
+ * @brief Convierte los campos carne,genero,residencia,edad,colegio,tipoColegio,trabaja,estadoCivil.
+ * @param campos Campos de una linea CSV.
+ * @return Estudiante equivalente.
+ * @throws runtime_error si falta un campo o la edad no es valida.
+ */
+Estudiante estudianteDesdeCsv(const vector<string> &campos) {
+    if (campos.size() != 8) {
+        throw runtime_error("se esperaban 8 campos y hay " + to_string(campos.size()));
+    }
+    Estudiante estudiante;
+    estudiante.carne = campos[0];
+    estudiante.genero = campos[1];
+    estudiante.residencia = campos[2];
+    if (!convertirNumero(campos[3], estudiante.edad) || estudiante.edad < 1 || estudiante.edad > 110) {
+        throw runtime_error("edad invalida '" + campos[3] + "'");
+    }
+    estudiante.colegioProcedencia = campos[4];
+    estudiante.tipoColegio = campos[5];
+    const auto trabaja = aMayusculas(campos[6]);
+    estudiante.trabaja = trabaja == "SI" || trabaja == "S";
+    estudiante.estadoCivil = campos[7];
+    if (estudiante.carne.empty()) {
+        throw runtime_error("carne vacio");
+    }
+    return estudiante;
+}
+
+/**
+ * @brief Convierte los campos carne,semestre,materia,nota.
+ * @param campos Campos de una linea CSV.
+ * @return Registro de historial equivalente.
+ * @throws runtime_error si falta un campo o un numero no es valido.
+ */
+RegistroHistorial registroDesdeCsv(const vector<string> &campos) {
+    if (campos.size() != 4) {
+        throw runtime_error("se esperaban 4 campos y hay " + to_string(campos.size()));
+    }
+    RegistroHistorial registro;
+    registro.carneEstudiante = campos[0];
+    if (!convertirNumero(campos[1], registro.semestre) || registro.semestre < 1 ||
+        registro.semestre > 20) {
+        throw runtime_error("semestre invalido '" + campos[1] + "'");
+    }
+    registro.materia = campos[2];
+    if (!convertirNumero(campos[3], registro.nota) || registro.nota < 0.0 || registro.nota > 100.0) {
+        throw runtime_error("nota invalida '" + campos[3] + "'");
+    }
+    if (registro.carneEstudiante.empty() || registro.materia.empty()) {
+        throw runtime_error("carne o materia vacios");
+    }
+    return registro;
+}
+
+/**
+ * @brief Encabezado de 32 bytes al inicio de estudiantes.bin e historial.bin (formato 2).
+ *
+ * cantidad y finDatos solo cuentan registros confirmados: los bytes posteriores a finDatos son una
+ * escritura interrumpida y se descartan al abrir el archivo.
+ */
+struct EncabezadoArchivo {
+    uint32_t firma = 0;
+    uint32_t version = 0;
+    uint64_t cantidad = 0;
+    uint32_t banderas = 0;
+    uint32_t reservado = 0;
+    uint64_t finDatos = 0;
+};
+static_assert(sizeof(EncabezadoArchivo) == 32 && sizeof(EncabezadoArchivo) % kAlineacionRegistro == 0);
+
+/**
+ * @brief Encabezado de 24 bytes de la tabla de desplazamientos (ruta + ".ofs").
+ *
+ * finDatos es la posicion siguiente al ultimo registro cubierto; con ella se comprueba que la tabla
+ * describe el archivo de datos actual antes de usarla.
+ */
+struct EncabezadoTabla {
+    uint32_t firma = 0;
+    uint32_t version = 0;
+    uint64_t cubiertos = 0;
+    uint64_t finDatos = 0;
+};
+static_assert(sizeof(EncabezadoTabla) == 24);
+
+/**
+ * @brief Pide al sistema operativo que lleve a disco los datos escritos en un archivo.
+ * @param ruta Ruta del archivo.
+ * @throws runtime_error si la sincronizacion falla.
+ */
+void sincronizarArchivo(const string &ruta) {
+#if PROYECTO_USA_MMAP
+    const int descriptor = ::open(ruta.c_str(), O_RDWR);
+    const auto correcto = descriptor >= 0 && ::fsync(descriptor) == 0;
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+    if (!correcto) {
+        throw runtime_error("No se pudo sincronizar " + ruta);
+    }
+#else
+    (void)ruta;
+#endif
+}
+
+/**
+ * @brief Configuracion del escritor por lotes de un archivo de registros.
+ *
+ * No hay temporizador: intervalo solo se revisa cuando llega otro anexo. Si no llegan mas, los
+ * registros esperan en el bufer hasta confirmar, que es lo unico que acota la latencia; por eso
+ * Aplicacion confirma despues de cada alta.
+ */
+struct PoliticaEscritura {
+    size_t bytesLote = kBytesLoteEscritura;        ///< Volcar al acumular esta cantidad de bytes.
+    chrono::milliseconds intervalo = kIntervaloVolcado; ///< Al anexar, volcar si el ultimo es mas viejo.
+    SincronizacionDisco sincronizacion = SincronizacionDisco::AlConfirmar;
+};
+
+/**
+ * @brief Archivo de registros de formato 2 con su tabla de desplazamientos.
+ *
+ * Cada registro empieza con su tamano (u32, multiplo de 8). La tabla con la posicion de cada
+ * registro se guarda en un archivo auxiliar (ruta + ".ofs") con la cantidad que cubre y su finDatos;
+ * si falta o esta atrasada se completa recorriendo los tamanos, sin decodificar registros, y si no
+ * es coherente con el archivo se descarta y se rehace completa.
+ *
+ * Las escrituras se agrupan: anexar deja los registros en un bufer y el archivo, que permanece
+ * abierto, recibe un volcado cuando el bufer supera PoliticaEscritura::bytesLote, cuando el ultimo
+ * volcado es mas viejo que PoliticaEscritura::intervalo (se revisa al anexar) o cuando se llama a
+ * confirmar. cantidad, finDatos y desplazamientos incluyen los registros pendientes; las lecturas
+ * hechas con mapear o abrirLectura vuelcan antes el bufer.
+ */
+class ArchivoRegistros {
+public:
+    ArchivoRegistros(string ruta, uint32_t firma)
+        : ruta_(move(ruta)), rutaTabla_(ruta_ + kExtensionDesplazamientos), firma_(firma) {}
+
+    ~ArchivoRegistros() {
+        try {
+            confirmar();
+        } catch (...) {
+            // Un destructor no debe propagar; los registros no volcados se pierden.
+        }
+    }
+
+    ArchivoRegistros(const ArchivoRegistros &) = delete;
+    ArchivoRegistros &operator=(const ArchivoRegistros &) = delete;
+
+    /**
+     * @brief Indica si el archivo existe con datos pero no empieza con la firma del formato 2.
+     * @return true cuando el archivo debe migrarse antes de abrirlo.
+     */
+    [[nodiscard]] bool tieneFormatoAnterior() const {
+        ifstream in(ruta_, ios::binary);
+        uint32_t firma = 0;
+        if (!in.is_open() || !in.read(reinterpret_cast<char *>(&firma), sizeof(firma))) {
+            return tamanoArchivoSeguro(ruta_) > 0;
+        }
+        return firma != firma_;
+    }
+
+    /**
+     * @brief Crea el archivo si no existe, valida su encabezado y carga la tabla de desplazamientos.
+     * @throws runtime_error si la firma o la version no corresponden o el archivo esta truncado.
+     */
+    void abrir() {
+        desplazamientos_.clear();
+        if (tamanoArchivoSeguro(ruta_) == 0) {
+            encabezado_ = {firma_, kVersionFormato, 0U, 0U, 0U, sizeof(EncabezadoArchivo)};
+            ofstream out(ruta_, ios::binary | ios::trunc);
+            out.write(reinterpret_cast<const char *>(&encabezado_), sizeof(encabezado_));
+            if (!out) {
+                throw runtime_error("No se pudo crear el archivo " + ruta_);
+            }
+            out.close();
+            guardarTabla();
+            abrirEscritura();
+            return;
+        }
+        ifstream in(ruta_, ios::binary);
+        if (!in.read(reinterpret_cast<char *>(&encabezado_), sizeof(encabezado_)) ||
+            encabezado_.firma != firma_) {
+            throw runtime_error("El archivo " + ruta_ + " no tiene un encabezado valido.");
+        }
+        if (encabezado_.version != kVersionFormato) {
+            throw runtime_error("Version de formato no soportada en " + ruta_);
+        }
+        in.close();
+        const auto tamano = static_cast<uint64_t>(tamanoArchivoSeguro(ruta_));
+        if (tamano < encabezado_.finDatos) {
+            throw runtime_error("El archivo " + ruta_ + " esta truncado.");
+        }
+        if (tamano > encabezado_.finDatos) {
+            fs::resize_file(ruta_, encabezado_.finDatos);
+        }
+        cargarTabla();
+        abrirEscritura();
+    }
+
+    /**
+     * @brief Anade registros ya codificados al bufer de escritura y vuelca si la politica lo pide.
+     * @param bytes Registros consecutivos.
+     * @param relativos Posicion de cada registro dentro de bytes.
+     * @return Posicion en el archivo del primer byte anadido.
+     * @throws runtime_error si un volcado falla; los registros de esta llamada se retiran del bufer,
+     *         de modo que el llamador puede tratarlos como no escritos.
+     */
+    uint64_t anexar(string_view bytes, const vector<uint64_t> &relativos) {
+        const auto anterior = encabezado_;
+        const auto inicio = encabezado_.finDatos;
+        // Las banderas describen el orden del archivo completo; un registro anexado puede romperlo.
+        encabezado_.banderas = 0U;
+        pendiente_.append(bytes);
+        for (const auto relativo : relativos) {
+            desplazamientos_.push_back(inicio + relativo);
+        }
+        encabezado_.cantidad += relativos.size();
+        encabezado_.finDatos += bytes.size();
+        if (pendiente_.size() >= politica_.bytesLote ||
+            chrono::steady_clock::now() - ultimoVolcado_ >= politica_.intervalo) {
+            try {
+                volcar(politica_.sincronizacion == SincronizacionDisco::Siempre);
+            } catch (...) {
+                // volcar solo vacia el bufer si termina y el siguiente volcado escribe desde
+                // confirmado_.finDatos; el encabezado se reescribe por si ya llego al disco.
+                pendiente_.resize(pendiente_.size() - bytes.size());
+                desplazamientos_.resize(desplazamientos_.size() - relativos.size());
+                encabezado_ = anterior;
+                encabezadoPendiente_ = true;
+                throw;
+            }
+        }
+        return inicio;
+    }
+
+    /**
+     * @brief Vuelca los registros pendientes y, salvo con SincronizacionDisco::Ninguna, los lleva a
+     *        disco antes de volver.
+     * @throws runtime_error si la escritura o la sincronizacion fallan.
+     */
+    void confirmar() const {
+        volcar(politica_.sincronizacion != SincronizacionDisco::Ninguna);
+    }
+
+    /**
+     * @brief Sustituye todo el contenido del archivo y lo vuelve a abrir.
+     * @param banderas Banderas del nuevo encabezado.
+     * @param registros Registros consecutivos ya codificados.
+     * @param cantidad Cantidad de registros.
+     * @throws runtime_error si el archivo no puede escribirse.
+     */
+    void reescribir(uint32_t banderas, string_view registros, uint64_t cantidad) {
+        volcar(false);
+        escritura_.close();
+        reemplazar(ruta_, firma_, banderas, registros, cantidad);
+        abrir();
+    }
+
+    /**
+     * @brief Cambia la politica del escritor; los registros pendientes se vuelcan antes.
+     * @param politica Nueva politica.
+     */
+    void establecerPolitica(const PoliticaEscritura &politica) {
+        volcar(false);
+        politica_ = politica;
+    }
+
+    /**
+     * @brief Devuelve la politica vigente del escritor.
+     */
+    [[nodiscard]] const PoliticaEscritura &politica() const {
+        return politica_;
+    }
+
+    /**
+     * @brief Mapea el archivo en memoria despues de volcar los registros pendientes.
+     * @return Archivo mapeado que incluye todos los registros anexados.
+     */
+    [[nodiscard]] ArchivoMapeado mapear() const {
+        volcar(false);
+        return ArchivoMapeado(ruta_);
+    }
+
+    /**
+     * @brief Abre el archivo para lectura despues de volcar los registros pendientes.
+     * @param posicion Posicion inicial del flujo.
+     * @return Flujo posicionado; sin abrir si el archivo no existe.
+     */
+    [[nodiscard]] ifstream abrirLectura(uint64_t posicion) const {
+        volcar(false);
+        ifstream in(ruta_, ios::binary);
+        in.seekg(static_cast<streamoff>(posicion));
+        return in;
+    }
+
+    /**
+     * @brief Escribe un archivo completo de formato 2 en un temporal y lo renombra sobre la ruta.
+     * @param ruta Ruta final del archivo.
+     * @param firma Firma del tipo de archivo.
+     * @param banderas Banderas del encabezado.
+     * @param registros Registros consecutivos ya codificados.
+     * @param cantidad Cantidad de registros.
+     * @throws runtime_error si el temporal no puede escribirse.
+     */
+    static void reemplazar(const string &ruta, uint32_t firma, uint32_t banderas,
+                           string_view registros, uint64_t cantidad) {
+        const auto temporal = ruta + ".tmp";
+        {
+            const EncabezadoArchivo encabezado{firma, kVersionFormato, cantidad, banderas, 0U,
+                                               sizeof(EncabezadoArchivo) + registros.size()};
+            ofstream out(temporal, ios::binary | ios::trunc);
+            out.write(reinterpret_cast<const char *>(&encabezado), sizeof(encabezado));
+            out.write(registros.data(), static_cast<streamsize>(registros.size()));
+            out.flush();
+            if (!out) {
+                throw runtime_error("No se pudo escribir " + temporal);
+            }
+        }
+        fs::rename(temporal, ruta);
+        fs::remove(ruta + kExtensionDesplazamientos);
+    }
+
+    /**
+     * @brief Devuelve la cantidad de registros confirmados.
+     */
+    [[nodiscard]] uint64_t cantidad() const {
+        return encabezado_.cantidad;
+    }
+
+    /**
+     * @brief Devuelve la posicion de cada registro, en orden.
+     */
+    [[nodiscard]] const vector<uint64_t> &desplazamientos() const {
+        return desplazamientos_;
+    }
+
+    /**
+     * @brief Devuelve la posicion siguiente al ultimo registro confirmado.
+     */
+    [[nodiscard]] uint64_t finDatos() const {
+        return encabezado_.finDatos;
+    }
+
+    /**
+     * @brief Devuelve las banderas del encabezado.
+     */
+    [[nodiscard]] uint32_t banderas() const {
+        return encabezado_.banderas;
+    }
+
+    /**
+     * @brief Devuelve la ruta del archivo de datos.
+     */
+    [[nodiscard]] const string &ruta() const {
+        return ruta_;
+    }
+
+private:
+    string ruta_;
+    string rutaTabla_;
+    uint32_t firma_;
+    EncabezadoArchivo encabezado_;
+    vector<uint64_t> desplazamientos_;
+    PoliticaEscritura politica_;
+
+    // Estado del escritor: vaciar el bufer no cambia el contenido logico del archivo, por lo que
+    // las lecturas const pueden volcarlo.
+    mutable fstream escritura_;
+    mutable string pendiente_;
+    mutable EncabezadoArchivo confirmado_;
+    mutable bool sinSincronizar_ = false;
+    mutable bool encabezadoPendiente_ = false;
+    mutable chrono::steady_clock::time_point ultimoVolcado_ = chrono::steady_clock::now();
+
+    /**
+     * @brief Abre el flujo de escritura que se mantiene durante la vida del objeto.
+     * @throws runtime_error si el archivo no puede abrirse.
+     */
+    void abrirEscritura() {
+        escritura_.close();
+        escritura_.clear();
+        escritura_.open(ruta_, ios::binary | ios::in | ios::out);
+        if (!escritura_.is_open()) {
+            throw runtime_error("No se pudo abrir " + ruta_ + " para escritura.");
+        }
+        confirmado_ = encabezado_;
+    }
+
+    /**
+     * @brief Escribe el bufer pendiente, luego el encabezado y al final la tabla auxiliar.
+     *
+     * El encabezado se actualiza despues de los datos: si el proceso se interrumpe antes, los
+     * registros nuevos quedan fuera de finDatos y se descartan al abrir.
+     * @param sincronizar Si es true, datos y encabezado se llevan a disco por separado y en orden.
+     * @throws runtime_error si la escritura o la sincronizacion fallan.
+     */
+    void volcar(bool sincronizar) const {
+        if (pendiente_.empty() && !encabezadoPendiente_) {
+            if (sincronizar && sinSincronizar_) {
+                sincronizarArchivo(ruta_);
+                sinSincronizar_ = false;
+            }
+            return;
+        }
+        escritura_.seekp(static_cast<streamoff>(confirmado_.finDatos));
+        escritura_.write(pendiente_.data(), static_cast<streamsize>(pendiente_.size()));
+        escritura_.flush();
+        if (!escritura_) {
+            escritura_.clear();
+            throw runtime_error("No se pudieron escribir los registros en " + ruta_);
+        }
+        if (sincronizar) {
+            sincronizarArchivo(ruta_);
+        }
+        escritura_.seekp(0);
+        escritura_.write(reinterpret_cast<const char *>(&encabezado_), sizeof(encabezado_));
+        escritura_.flush();
+        if (!escritura_) {
+            escritura_.clear();
+            throw runtime_error("No se pudo actualizar el encabezado de " + ruta_);
+        }
+        if (sincronizar) {
+            sincronizarArchivo(ruta_);
+        }
+        sinSincronizar_ = !sincronizar;
+        anexarTabla(encabezado_.cantidad - confirmado_.cantidad);
+        confirmado_ = encabezado_;
+        pendiente_.clear();
+        encabezadoPendiente_ = false;
+        ultimoVolcado_ = chrono::steady_clock::now();
+    }
+
+    /**
+     * @brief Lee la tabla auxiliar y completa las posiciones que falten recorriendo el archivo.
+     *
+     * Una tabla cuyas posiciones no crecen, no estan alineadas o se salen del finDatos que declara,
+     * o cuyo ultimo registro no termina en ese finDatos, se descarta y se rehace desde el inicio.
+     * @throws runtime_error si un registro tiene un tamano imposible.
+     */
+    void cargarTabla() {
+        auto posicion = leerTabla();
+        if (desplazamientos_.size() == encabezado_.cantidad) {
+            return;
+        }
+
+        const ArchivoMapeado archivo(ruta_);
+        const auto contenido = archivo.contenido();
+        desplazamientos_.reserve(encabezado_.cantidad);
+        while (desplazamientos_.size() < encabezado_.cantidad) {
+            const auto tamano = posicion + sizeof(uint32_t) <= encabezado_.finDatos
+                                    ? extraerValor<uint32_t>(contenido.data() + posicion)
+                                    : 0U;
+            if (tamano < sizeof(uint32_t) || tamano % kAlineacionRegistro != 0 ||
+                posicion + tamano > encabezado_.finDatos) {
+                throw runtime_error("Registro danado en " + ruta_);
+            }
+            desplazamientos_.push_back(posicion);
+            posicion += tamano;
+        }
+        guardarTabla();
+    }
+
+    /**
+     * @brief Carga la tabla auxiliar en desplazamientos_ si es coherente con el archivo de datos.
+     *
+     * Del archivo de datos solo se lee el tamano del ultimo registro cubierto.
+     * @return Posicion siguiente al ultimo registro cubierto; el inicio de los datos si la tabla
+     *         falta o se descarto.
+     */
+    uint64_t leerTabla() {
+        desplazamientos_.clear();
+        ifstream in(rutaTabla_, ios::binary);
+        EncabezadoTabla tabla;
+        if (!in.read(reinterpret_cast<char *>(&tabla), sizeof(tabla)) ||
+            tabla.firma != kFirmaDesplazamientos || tabla.version != kVersionDesplazamientos ||
+            tabla.cubiertos > encabezado_.cantidad || tabla.finDatos > encabezado_.finDatos) {
+            return sizeof(EncabezadoArchivo);
+        }
+        desplazamientos_.resize(tabla.cubiertos);
+        if (!in.read(reinterpret_cast<char *>(desplazamientos_.data()),
+                     static_cast<streamsize>(tabla.cubiertos * sizeof(uint64_t)))) {
+            desplazamientos_.clear();
+            return sizeof(EncabezadoArchivo);
+        }
+        // Cada registro ocupa al menos kAlineacionRegistro bytes, por eso las posiciones crecen
+        // estrictamente; el tamano de cada uno es la distancia a la siguiente.
+        uint64_t minimo = sizeof(EncabezadoArchivo);
+        for (const auto desplazamiento : desplazamientos_) {
+            if (desplazamiento < minimo || desplazamiento % kAlineacionRegistro != 0) {
+                desplazamientos_.clear();
+                return sizeof(EncabezadoArchivo);
+            }
+            minimo = desplazamiento + kAlineacionRegistro;
+        }
+        auto coherente = desplazamientos_.empty() ? tabla.finDatos == sizeof(EncabezadoArchivo)
+                                                  : minimo <= tabla.finDatos;
+        if (coherente && !desplazamientos_.empty()) {
+            ifstream datos(ruta_, ios::binary);
+            datos.seekg(static_cast<streamoff>(desplazamientos_.back()));
+            uint32_t tamano = 0;
+            coherente = datos.read(reinterpret_cast<char *>(&tamano), sizeof(tamano)) &&
+                        desplazamientos_.back() + tamano == tabla.finDatos;
+        }
+        if (!coherente) {
+            desplazamientos_.clear();
+            return sizeof(EncabezadoArchivo);
+        }
+        return tabla.finDatos;
+    }
+
+    /**
+     * @brief Reescribe por completo la tabla auxiliar.
+     */
+    void guardarTabla() const {
+        ofstream out(rutaTabla_, ios::binary | ios::trunc);
+        const EncabezadoTabla tabla{kFirmaDesplazamientos, kVersionDesplazamientos,
+                                    desplazamientos_.size(), encabezado_.finDatos};
+        out.write(reinterpret_cast<const char *>(&tabla), sizeof(tabla));
+        out.write(reinterpret_cast<const char *>(desplazamientos_.data()),
+                  static_cast<streamsize>(tabla.cubiertos * sizeof(uint64_t)));
+    }
+
+    /**
+     * @brief Anade a la tabla auxiliar las ultimas posiciones y confirma la cantidad cubierta.
+     * @param nuevos Cantidad de posiciones agregadas al final de desplazamientos_.
+     */
+    void anexarTabla(size_t nuevos) const {
+        fstream tabla(rutaTabla_, ios::binary | ios::in | ios::out);
+        if (!tabla.is_open()) {
+            guardarTabla();
+            return;
+        }
+        const uint64_t cubiertos = desplazamientos_.size();
+        tabla.seekp(
+            static_cast<streamoff>(sizeof(EncabezadoTabla) + (cubiertos - nuevos) * sizeof(uint64_t)));
+        tabla.write(reinterpret_cast<const char *>(desplazamientos_.data() + (cubiertos - nuevos)),
+                    static_cast<streamsize>(nuevos * sizeof(uint64_t)));
+        // La cantidad y finDatos se escriben despues de las posiciones que cubren.
+        tabla.seekp(sizeof(EncabezadoTabla::firma) + sizeof(EncabezadoTabla::version));
+        tabla.write(reinterpret_cast<const char *>(&cubiertos), sizeof(cubiertos));
+        tabla.write(reinterpret_cast<const char *>(&encabezado_.finDatos), sizeof(encabezado_.finDatos));
+    }
+};
+
+/**
+ * @brief Devuelve los bytes de un registro de formato 2 a partir de su posicion.
+ * @param contenido Archivo completo.
+ * @param desplazamiento Posicion del registro.
+ * @return Bytes del registro.
+ * @throws runtime_error si la posicion o el tamano del registro salen del archivo.
+ */
+string_view bytesRegistro(string_view contenido, uint64_t desplazamiento) {
+    if (desplazamiento > contenido.size() || contenido.size() - desplazamiento < sizeof(uint32_t)) {
+        throw runtime_error("Posicion de registro fuera del archivo: " + to_string(desplazamiento));
+    }
+    const auto tamano = extraerValor<uint32_t>(contenido.data() + desplazamiento);
+    if (tamano < sizeof(uint32_t) || tamano > contenido.size() - desplazamiento) {
+        throw runtime_error("Registro danado en la posicion " + to_string(desplazamiento));
+    }
+    return contenido.substr(desplazamiento, tamano);
+}
+
+/**
+ * @brief Cantidad minima de registros para decodificar un archivo en paralelo.
+ */
+constexpr size_t kUmbralDecodificacionParalela = 8192;
+
+/**
+ * @brief Proporciona persistencia binaria para registros de estudiantes.
+ */
+class RepositorioEstudiantes {
+public:
+    explicit RepositorioEstudiantes(string ruta)
+        : archivo_(move(ruta), kFirmaEstudiantes), rutaIndice_(archivo_.ruta() + kExtensionIndice) {
+        migrarFormatoAnterior();
+        archivo_.abrir();
+        cargarIndice();
+    }
+
+    ~RepositorioEstudiantes() {
+        try {
+            confirmar();
+        } catch (...) {
+            // Si el indice queda atrasado se completa al abrir de nuevo el repositorio.
+        }
+    }
+
+    RepositorioEstudiantes(const RepositorioEstudiantes &) = delete;
+    RepositorioEstudiantes &operator=(const RepositorioEstudiantes &) = delete;
+
+    /**
+     * @brief Carga todos los estudiantes desde el disco.
+     * @param pool Si se indica y el archivo es grande, los registros se decodifican en paralelo.
+     * @return Vector con cada estudiante persistido, en el orden del archivo.
+     */
+    vector<Estudiante> cargarTodos(PoolTrabajo *pool = nullptr) const {
+        MEDIR_FASE(FaseMedida::LecturaEstudiantes);
+        vector<Estudiante> estudiantes(archivo_.cantidad());
+        CONTAR(ContadorMedido::RegistrosDecodificados, estudiantes.size());
+        CONTAR(ContadorMedido::BytesLeidos, archivo_.finDatos() - sizeof(EncabezadoArchivo));
+        CONTAR(ContadorMedido::CadenasCreadas, estudiantes.size() * kCadenasPorEstudiante);
+        if (modoLectura_ == ModoLectura::Mapeado) {
+            const auto archivo = archivo_.mapear();
+            const auto contenido = archivo.contenido();
+            const auto &desplazamientos = archivo_.desplazamientos();
+            const auto decodificar = [&](size_t inicio, size_t fin) {
+                VistaEstudiante vista;
+                for (auto k = inicio; k < fin; ++k) {
+                    if (!leerVistaEstudiante(bytesRegistro(contenido, desplazamientos[k]), vista)) {
+                        throw runtime_error("Registro de estudiante danado.");
+                    }
+                    estudiantes[k] = aEstudiante(vista);
+                }
+            };
+            // Cada registro tiene su posicion en la tabla, asi que cada hilo escribe su propio tramo.
+            if (pool != nullptr && estudiantes.size() >= kUmbralDecodificacionParalela) {
+                repartirRango(*pool, true, estudiantes.size(), decodificar);
+            } else {
+                decodificar(0, estudiantes.size());
+            }
+            return estudiantes;
+        }
+        auto in = archivo_.abrirLectura(sizeof(EncabezadoArchivo));
+        for (auto &estudiante : estudiantes) {
+            if (!leerEstudiante(in, estudiante)) {
+                throw runtime_error("Registro de estudiante danado.");
+            }
+        }
+        return estudiantes;
+    }
+
+    /**
+     * @brief Recorre los registros del archivo mapeado en memoria sin materializarlos.
+     * @param visitar Funcion invocada con cada VistaEstudiante; las vistas solo son validas durante
+     *        la llamada.
+     */
+    template <typename Visitante>
+    void recorrer(Visitante &&visitar) const {
+        MEDIR_FASE(FaseMedida::LecturaEstudiantes);
+        CONTAR(ContadorMedido::RegistrosDecodificados, archivo_.cantidad());
+        CONTAR(ContadorMedido::BytesLeidos, archivo_.finDatos() - sizeof(EncabezadoArchivo));
+        const auto archivo = archivo_.mapear();
+        const auto contenido = archivo.contenido();
+        VistaEstudiante vista;
+        for (const auto desplazamiento : archivo_.desplazamientos()) {
+            if (!leerVistaEstudiante(bytesRegistro(contenido, desplazamiento), vista)) {
+                throw runtime_error("Registro de estudiante danado.");
+            }
+            visitar(vista);
+        }
+    }
+
+    /**
+     * @brief Selecciona la estrategia usada por cargarTodos.
+     * @param modo Lectura por flujo o sobre el archivo mapeado en memoria.
+     */
+    void establecerModoLectura(ModoLectura modo) {
+        modoLectura_ = modo;
+    }
+
+    /**
+     * @brief Anade un nuevo estudiante al disco y lo registra en el indice de carnes.
+     * @param estudiante Registro a persistir.
+     * @throws runtime_error cuando el identificador ya existe o no se puede abrir el archivo.
+     */
+    void agregar(const Estudiante &estudiante) {
+        if (existe(estudiante.carne)) {
+            throw runtime_error("El carne ingresado ya esta registrado.");
+        }
+        string bytes;
+        escribirEstudiante(bytes, estudiante);
+        const auto desplazamiento = archivo_.anexar(bytes, {0U});
+        indice_.emplace(estudiante.carne, desplazamiento);
+        entradasPendientes_.emplace_back(estudiante.carne, desplazamiento);
+    }
+
+    /**
+     * @brief Anade varios estudiantes al bufer de escritura en una sola operacion.
+     * @param estudiantes Registros a persistir, en orden.
+     * @throws runtime_error si un carne esta vacio, repetido en el lote o ya registrado, o si falla la
+     *         escritura; en los tres primeros casos no se escribe nada.
+     */
+    void agregarLote(const vector<Estudiante> &estudiantes) {
+        unordered_set<string_view> nuevos;
+        nuevos.reserve(estudiantes.size());
+        for (const auto &estudiante : estudiantes) {
+            if (estudiante.carne.empty()) {
+                throw runtime_error("Hay un estudiante sin carne.");
+            }
+            if (existe(estudiante.carne) || !nuevos.insert(estudiante.carne).second) {
+                throw runtime_error("El carne " + estudiante.carne + " ya esta registrado.");
+            }
+        }
+
+        string bytes;
+        vector<uint64_t> relativos;
+        relativos.reserve(estudiantes.size());
+        for (const auto &estudiante : estudiantes) {
+            relativos.push_back(bytes.size());
+            escribirEstudiante(bytes, estudiante);
+        }
+        const auto inicio = archivo_.anexar(bytes, relativos);
+        entradasPendientes_.reserve(entradasPendientes_.size() + estudiantes.size());
+        indice_.reserve(indice_.size() + estudiantes.size());
+        for (size_t i = 0; i < estudiantes.size(); ++i) {
+            entradasPendientes_.emplace_back(estudiantes[i].carne, inicio + relativos[i]);
+            indice_.emplace(estudiantes[i].carne, inicio + relativos[i]);
+        }
+    }
+
+    /**
+     * @brief Confirma los estudiantes anadidos y agrega sus entradas al indice de carnes en disco.
+     *
+     * El indice se escribe despues de los datos, asi que nunca cubre registros sin confirmar.
+     * @throws runtime_error si el archivo de datos no puede escribirse o sincronizarse.
+     */
+    void confirmar() {
+        archivo_.confirmar();
+        if (entradasPendientes_.empty()) {
+            return;
+        }
+        tamanoIndexado_ = archivo_.finDatos();
+        anexarEntradasIndice(entradasPendientes_);
+        entradasPendientes_.clear();
+    }
+
+    /**
+     * @brief Configura cuando se vuelcan y sincronizan las escrituras.
+     * @param politica Tamano de lote, intervalo de volcado y politica de fsync.
+     */
+    void establecerPoliticaEscritura(const PoliticaEscritura &politica) {
+        archivo_.establecerPolitica(politica);
+    }
+
+    /**
+     * @brief Devuelve la politica de escritura vigente.
+     */
+    [[nodiscard]] const PoliticaEscritura &politicaEscritura() const {
+        return archivo_.politica();
+    }
+
+    /**
+     * @brief Verifica si existe un estudiante con el identificador indicado.
+     * @param carne Carne que se desea buscar.
+     * @return true si el estudiante existe; false en caso contrario.
+     */
+    bool existe(const string &carne) const {
+        return indice_.find(carne) != indice_.end();
+    }
+
+    /**
+     * @brief Recupera un estudiante leyendo unicamente su registro a partir del indice.
+     * @param carne Carne que se desea buscar.
+     * @return Estudiante encontrado o nullopt si el carne no esta registrado.
+     */
+    optional<Estudiante> buscar(const string &carne) const {
+        const auto it = indice_.find(carne);
+        if (it == indice_.end()) {
+            return nullopt;
+        }
+        auto in = archivo_.abrirLectura(it->second);
+        if (!in.is_open()) {
+            return nullopt;
+        }
+        Estudiante estudiante;
+        if (!leerEstudiante(in, estudiante) || estudiante.carne != carne) {
+            return nullopt;
+        }
+        return estudiante;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes registrados en el indice.
+     * @return Numero de carnes indexados.
+     */
+    [[nodiscard]] size_t cantidad() const {
+        return indice_.size();
+    }
+
+    /**
+     * @brief Devuelve la ruta del archivo del repositorio.
+     * @return Referencia constante a la cadena de ruta.
+     */
+    [[nodiscard]] const string &ruta() const {
+        return archivo_.ruta();
+    }
+
+    /**
+     * @brief Indica si el archivo no tiene registros.
+     * @return true cuando no hay estudiantes persistidos.
+     */
+    [[nodiscard]] bool vacio() const {
+        return archivo_.cantidad() == 0;
+    }
+
+private:
+    ArchivoRegistros archivo_;
+    string rutaIndice_;
+    unordered_map<string, uint64_t> indice_;
+    vector<pair<string, uint64_t>> entradasPendientes_;
+    uint64_t tamanoIndexado_ = 0;
+    ModoLectura modoLectura_ = ModoLectura::Mapeado;
+
+    /**
+     * @brief Convierte un archivo del formato 1 al formato 2 y descarta el indice de carnes viejo.
+     */
+    void migrarFormatoAnterior() {
+        if (!archivo_.tieneFormatoAnterior()) {
+            return;
+        }
+        string bytes;
+        uint64_t cantidad = 0;
+        {
+            const ArchivoMapeado archivo(archivo_.ruta());
+            LectorBinario lector(archivo.contenido());
+            VistaEstudiante vista;
+            while (lector.quedanDatos() && leerVistaEstudianteV1(lector, vista)) {
+                escribirEstudiante(bytes, vista);
+                ++cantidad;
+            }
+        }
+        ArchivoRegistros::reemplazar(archivo_.ruta(), kFirmaEstudiantes, 0U, bytes, cantidad);
+        fs::remove(rutaIndice_);
+    }
+
+    /**
+     * @brief Carga el indice auxiliar y lo sincroniza con el archivo de datos.
+     *
+     * Si el archivo auxiliar falta, esta danado o cubre mas bytes de los confirmados en el archivo
+     * de datos, el indice se reconstruye completo; si solo cubre un prefijo, se indexa la cola.
+     */
+    void cargarIndice() {
+        indice_.clear();
+        tamanoIndexado_ = 0;
+        const auto tamanoDatos = archivo_.finDatos();
+        if (!leerArchivoIndice() || tamanoIndexado_ > tamanoDatos) {
+            indice_.clear();
+            tamanoIndexado_ = 0;
+        }
+        if (tamanoIndexado_ != tamanoDatos) {
+            indexarDesde(tamanoIndexado_);
+            guardarIndice();
+        }
+    }
+
+    /**
+     * @brief Lee las entradas del archivo auxiliar de indice.
+     * @return true si el archivo existe y su encabezado es valido; false en caso contrario.
+     */
+    bool leerArchivoIndice() {
+        ifstream in(rutaIndice_, ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        uint32_t firma = 0;
+        uint64_t tamanoCubierto = 0;
+        if (!in.read(reinterpret_cast<char *>(&firma), sizeof(firma)) ||
+            !in.read(reinterpret_cast<char *>(&tamanoCubierto), sizeof(tamanoCubierto)) ||
+            firma != kFirmaIndiceCarnes) {
+            return false;
+        }
+        string carne;
+        uint64_t desplazamiento = 0;
+        while (leerCadena(in, carne) &&
+               in.read(reinterpret_cast<char *>(&desplazamiento), sizeof(desplazamiento))) {
+            // Las entradas escritas despues del ultimo encabezado confirmado se ignoran.
+            if (desplazamiento < tamanoCubierto) {
+                indice_[carne] = desplazamiento;
+            }
+        }
+        tamanoIndexado_ = tamanoCubierto;
+        return true;
+    }
+
+    /**
+     * @brief Indexa los registros del archivo de datos a partir de un desplazamiento.
+     * @param inicio Desplazamiento del primer registro que aun no esta indexado.
+     */
+    void indexarDesde(uint64_t inicio) {
+        const auto archivo = archivo_.mapear();
+        const auto contenido = archivo.contenido();
+        const auto &desplazamientos = archivo_.desplazamientos();
+        VistaEstudiante vista;
+        for (auto it = lower_bound(desplazamientos.begin(), desplazamientos.end(), inicio);
+             it != desplazamientos.end(); ++it) {
+            if (leerVistaEstudiante(bytesRegistro(contenido, *it), vista)) {
+                indice_[string(vista.carne)] = *it;
+            }
+        }
+        tamanoIndexado_ = archivo_.finDatos();
+    }
+
+    /**
+     * @brief Reescribe por completo el archivo auxiliar con el indice en memoria.
+     */
+    void guardarIndice() const {
+        ofstream out(rutaIndice_, ios::binary | ios::trunc);
+        if (!out.is_open()) {
+            return;
+        }
+        out.write(reinterpret_cast<const char *>(&kFirmaIndiceCarnes), sizeof(kFirmaIndiceCarnes));
+        out.write(reinterpret_cast<const char *>(&tamanoIndexado_), sizeof(tamanoIndexado_));
+        for (const auto &[carne, desplazamiento] : indice_) {
+            escribirCadena(out, carne);
+            out.write(reinterpret_cast<const char *>(&desplazamiento), sizeof(desplazamiento));
+        }
+    }
+
+    /**
+     * @brief Anade entradas al archivo auxiliar en una sola escritura y confirma el tamano cubierto.
+     * @param entradas Pares (carne, posicion del registro dentro del archivo de datos).
+     */
+    void anexarEntradasIndice(const vector<pair<string, uint64_t>> &entradas) const {
+        fstream archivo(rutaIndice_, ios::binary | ios::in | ios::out);
+        if (!archivo.is_open()) {
+            guardarIndice();
+            return;
+        }
+        ostringstream bloque;
+        for (const auto &[carne, desplazamiento] : entradas) {
+            escribirCadena(bloque, carne);
+            bloque.write(reinterpret_cast<const char *>(&desplazamiento), sizeof(desplazamiento));
+        }
+        const auto bytes = bloque.str();
+        archivo.seekp(0, ios::end);
+        archivo.write(bytes.data(), static_cast<streamsize>(bytes.size()));
+        archivo.seekp(sizeof(kFirmaIndiceCarnes));
+        archivo.write(reinterpret_cast<const char *>(&tamanoIndexado_), sizeof(tamanoIndexado_));
+    }
+};
+
+/**
+ * @brief Proporciona persistencia binaria para los registros de historial academico.
+ */
+class RepositorioHistorial {
+public:
+    explicit RepositorioHistorial(string ruta) : archivo_(move(ruta), kFirmaHistorial) {
+        migrarFormatoAnterior();
+        archivo_.abrir();
+    }
+
+    /**
+     * @brief Carga todos los registros de historial desde el disco.
+     * @param pool Si se indica y el archivo es grande, los registros se decodifican en paralelo.
+     * @return Vector con cada registro persistido, en el orden del archivo.
+     */
+    vector<RegistroHistorial> cargarTodos(PoolTrabajo *pool = nullptr) const {
+        MEDIR_FASE(FaseMedida::LecturaHistorial);
+        vector<RegistroHistorial> registros(archivo_.cantidad());
+        CONTAR(ContadorMedido::RegistrosDecodificados, registros.size());
+        CONTAR(ContadorMedido::BytesLeidos, archivo_.finDatos() - sizeof(EncabezadoArchivo));
+        CONTAR(ContadorMedido::CadenasCreadas, registros.size() * kCadenasPorRegistroHistorial);
+        if (modoLectura_ == ModoLectura::Mapeado) {
+            const auto archivo = archivo_.mapear();
+            const auto contenido = archivo.contenido();
+            const auto &desplazamientos = archivo_.desplazamientos();
+            const auto decodificar = [&](size_t inicio, size_t fin) {
+                VistaRegistroHistorial vista;
+                for (auto k = inicio; k < fin; ++k) {
+                    const auto registro = bytesRegistro(contenido, desplazamientos[k]);
+                    if (!leerVistaRegistroHistorial(registro, vista)) {
+                        throw runtime_error("Registro de historial danado.");
+                    }
+                    registros[k] = aRegistroHistorial(vista);
+                }
+            };
+            if (pool != nullptr && registros.size() >= kUmbralDecodificacionParalela) {
+                repartirRango(*pool, true, registros.size(), decodificar);
+            } else {
+                decodificar(0, registros.size());
+            }
+            return registros;
+        }
+        auto in = archivo_.abrirLectura(sizeof(EncabezadoArchivo));
+        for (auto &registro : registros) {
+            if (!leerRegistroHistorial(in, registro)) {
+                throw runtime_error("Registro de historial danado.");
+            }
+        }
+        return registros;
+    }
+
+    /**
+     * @brief Recorre los registros del archivo mapeado en memoria sin materializarlos.
+     * @param visitar Funcion invocada con cada VistaRegistroHistorial; las vistas solo son validas
+     *        durante la llamada.
+     */
+    template <typename Visitante>
+    void recorrer(Visitante &&visitar) const {
+        MEDIR_FASE(FaseMedida::LecturaHistorial);
+        CONTAR(ContadorMedido::RegistrosDecodificados, archivo_.cantidad());
+        CONTAR(ContadorMedido::BytesLeidos, archivo_.finDatos() - sizeof(EncabezadoArchivo));
+        const auto archivo = archivo_.mapear();
+        const auto contenido = archivo.contenido();
+        VistaRegistroHistorial vista;
+        for (const auto desplazamiento : archivo_.desplazamientos()) {
+            if (!leerVistaRegistroHistorial(bytesRegistro(contenido, desplazamiento), vista)) {
+                throw runtime_error("Registro de historial danado.");
+            }
+            visitar(vista);
+        }
+    }
+
+    /**
+     * @brief Selecciona la estrategia usada por cargarTodos.
+     * @param modo Lectura por flujo o sobre el archivo mapeado en memoria.
+     */
+    void establecerModoLectura(ModoLectura modo) {
+        modoLectura_ = modo;
+    }
+
+    /**
+     * @brief Recorre el archivo mapeado dividido en tramos contiguos que se decodifican en el pool.
+     *
+     * Los limites de cada tramo salen de la tabla de desplazamientos. Las llamadas de un mismo tramo
+     * ocurren en un solo hilo y en el orden del archivo, y el tramo t precede al tramo t + 1.
+     * @param pool Pool de hilos.
+     * @param tramos Cantidad de tramos; con 1 el recorrido es serial.
+     * @param visitar Funcion invocada como visitar(tramo, vista); la vista solo es valida durante
+     *        la llamada.
+     */
+    template <typename Visitante>
+    void recorrerPorTramos(PoolTrabajo &pool, size_t tramos, Visitante &&visitar) const {
+        MEDIR_FASE(FaseMedida::LecturaHistorial);
+        CONTAR(ContadorMedido::RegistrosDecodificados, archivo_.cantidad());
+        CONTAR(ContadorMedido::BytesLeidos, archivo_.finDatos() - sizeof(EncabezadoArchivo));
+        const auto archivo = archivo_.mapear();
+        const auto contenido = archivo.contenido();
+        const auto &desplazamientos = archivo_.desplazamientos();
+        const auto total = desplazamientos.size();
+        repartirRango(pool, tramos > 1, tramos, [&](size_t primero, size_t ultimo) {
+            VistaRegistroHistorial vista;
+            for (auto tramo = primero; tramo < ultimo; ++tramo) {
+                for (auto k = total * tramo / tramos; k < total * (tramo + 1) / tramos; ++k) {
+                    const auto registro = bytesRegistro(contenido, desplazamientos[k]);
+                    if (!leerVistaRegistroHistorial(registro, vista)) {
+                        throw runtime_error("Registro de historial danado.");
+                    }
+                    visitar(tramo, vista);
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief Anade un registro de historial al bufer de escritura; queda en disco al confirmar o
+     *        en el siguiente volcado por tamano o tiempo.
+     * @param registro Registro a persistir.
+     * @throws runtime_error si un volcado falla.
+     */
+    void agregar(const RegistroHistorial &registro) {
+        string bytes;
+        escribirRegistroHistorial(bytes, registro);
+        archivo_.anexar(bytes, {0U});
+    }
+
+    /**
+     * @brief Anade varios registros de historial al bufer de escritura en una sola operacion.
+     * @param registros Registros a persistir, en orden.
+     * @throws runtime_error si un volcado falla.
+     */
+    void agregarLote(const vector<RegistroHistorial> &registros) {
+        string bytes;
+        vector<uint64_t> relativos;
+        relativos.reserve(registros.size());
+        for (const auto &registro : registros) {
+            relativos.push_back(bytes.size());
+            escribirRegistroHistorial(bytes, registro);
+        }
+        archivo_.anexar(bytes, relativos);
+    }
+
+    /**
+     * @brief Vuelca los registros pendientes y los sincroniza segun la politica de escritura.
+     * @throws runtime_error si el archivo no puede escribirse o sincronizarse.
+     */
+    void confirmar() {
+        archivo_.confirmar();
+    }
+
+    /**
+     * @brief Reescribe el archivo con los registros agrupados por carne y, dentro de cada carne, por
+     *        semestre, y lo marca como ordenado en el encabezado.
+     *
+     * El ordenamiento es estable: las notas de un mismo semestre conservan el orden de registro.
+     * La marca se pierde con el siguiente registro anexado.
+     * @throws runtime_error si el archivo esta danado o no puede reescribirse.
+     */
+    void compactar() {
+        string bytes;
+        {
+            const auto archivo = archivo_.mapear();
+            const auto contenido = archivo.contenido();
+            const auto &desplazamientos = archivo_.desplazamientos();
+            vector<pair<string_view, int>> claves(desplazamientos.size());
+            VistaRegistroHistorial vista;
+            for (size_t k = 0; k < desplazamientos.size(); ++k) {
+                if (!leerVistaRegistroHistorial(bytesRegistro(contenido, desplazamientos[k]), vista)) {
+                    throw runtime_error("Registro de historial danado.");
+                }
+                claves[k] = {vista.carneEstudiante, vista.semestre};
+            }
+            vector<uint32_t> orden(desplazamientos.size());
+            iota(orden.begin(), orden.end(), 0U);
+            stable_sort(orden.begin(), orden.end(),
+                        [&](uint32_t a, uint32_t b) { return claves[a] < claves[b]; });
+            bytes.reserve(archivo_.finDatos() - sizeof(EncabezadoArchivo));
+            for (const auto k : orden) {
+                bytes.append(bytesRegistro(contenido, desplazamientos[k]));
+            }
+        }
+        archivo_.reescribir(kBanderaOrdenadoPorCarne, bytes, archivo_.cantidad());
+    }
+
+    /**
+     * @brief Recorre, en el orden del archivo, los registros de un carne.
+     *
+     * Si el archivo esta compactado se ubica el primer registro con una busqueda binaria sobre la
+     * tabla de desplazamientos; si no, se recorre el archivo completo.
+     * @param carne Carne buscado.
+     * @param visitar Funcion invocada con cada VistaRegistroHistorial del carne.
+     */
+    template <typename Visitante>
+    void recorrerCarne(string_view carne, Visitante &&visitar) const {
+        if (!ordenadoPorCarne()) {
+            recorrer([&](const VistaRegistroHistorial &vista) {
+                if (vista.carneEstudiante == carne) {
+                    visitar(vista);
+                }
+            });
+            return;
+        }
+        const auto archivo = archivo_.mapear();
+        const auto contenido = archivo.contenido();
+        const auto &desplazamientos = archivo_.desplazamientos();
+        VistaRegistroHistorial vista;
+        const auto carneEn = [&](uint64_t desplazamiento) {
+            if (!leerVistaRegistroHistorial(bytesRegistro(contenido, desplazamiento), vista)) {
+                throw runtime_error("Registro de historial danado.");
+            }
+            return vista.carneEstudiante;
+        };
+        auto it = partition_point(
+            desplazamientos.begin(), desplazamientos.end(),
+            [&](uint64_t desplazamiento) { return carneEn(desplazamiento) < carne; });
+        for (; it != desplazamientos.end() && carneEn(*it) == carne; ++it) {
+            visitar(vista);
+        }
+    }
+
+    /**
+     * @brief Recorre el archivo una sola vez y entrega, en el orden recibido, los registros de cada
+     *        carne pedido.
+     *
+     * Del primer recorrido solo se guarda el numero de cada registro de los carnes pedidos; al
+     * entregar un carne sus vistas se decodifican sobre el mismo mapeo y se liberan despues.
+     * @param carnes Carnes distintos, en el orden en que se entregan.
+     * @param visitar Funcion visitar(posicion, vistas) invocada una vez por carne, con su posicion en
+     *        carnes y sus registros en el orden del archivo; las vistas solo son validas durante la
+     *        llamada.
+     */
+    template <typename Visitante>
+    void recorrerPorCarnes(span<const string_view> carnes, Visitante &&visitar) const {
+        MEDIR_FASE(FaseMedida::LecturaHistorial);
+        CONTAR(ContadorMedido::RegistrosDecodificados, archivo_.cantidad());
+        CONTAR(ContadorMedido::BytesLeidos, archivo_.finDatos() - sizeof(EncabezadoArchivo));
+        unordered_map<string_view, size_t> posiciones;
+        posiciones.reserve(carnes.size());
+        for (size_t posicion = 0; posicion < carnes.size(); ++posicion) {
+            posiciones.emplace(carnes[posicion], posicion);
+        }
+        const auto archivo = archivo_.mapear();
+        const auto contenido = archivo.contenido();
+        const auto &desplazamientos = archivo_.desplazamientos();
+        const auto leer = [&](size_t k, VistaRegistroHistorial &vista) {
+            if (!leerVistaRegistroHistorial(bytesRegistro(contenido, desplazamientos[k]), vista)) {
+                throw runtime_error("Registro de historial danado.");
+            }
+        };
+        vector<vector<uint32_t>> registros(carnes.size());
+        VistaRegistroHistorial vista;
+        for (size_t k = 0; k < desplazamientos.size(); ++k) {
+            leer(k, vista);
+            if (const auto it = posiciones.find(vista.carneEstudiante); it != posiciones.end()) {
+                registros[it->second].push_back(static_cast<uint32_t>(k));
+            }
+        }
+        vector<VistaRegistroHistorial> vistas;
+        for (size_t posicion = 0; posicion < carnes.size(); ++posicion) {
+            vistas.resize(registros[posicion].size());
+            for (size_t j = 0; j < vistas.size(); ++j) {
+                leer(registros[posicion][j], vistas[j]);
+            }
+            visitar(posicion, span<const VistaRegistroHistorial>(vistas));
+            vector<uint32_t>().swap(registros[posicion]);
+        }
+    }
+
+    /**
+     * @brief Indica si el archivo conserva el orden por carne y semestre de la ultima compactacion.
+     * @return true si los registros de cada carne son contiguos y estan en orden de carne.
+     */
+    [[nodiscard]] bool ordenadoPorCarne() const {
+        return (archivo_.banderas() & kBanderaOrdenadoPorCarne) != 0U;
+    }
+
+    /**
+     * @brief Configura cuando se vuelcan y sincronizan las escrituras.
+     * @param politica Tamano de lote, intervalo de volcado y politica de fsync.
+     */
+    void establecerPoliticaEscritura(const PoliticaEscritura &politica) {
+        archivo_.establecerPolitica(politica);
+    }
+
+    /**
+     * @brief Devuelve la politica de escritura vigente.
+     */
+    [[nodiscard]] const PoliticaEscritura &politicaEscritura() const {
+        return archivo_.politica();
+    }
+
+    /**
+     * @brief Devuelve la cantidad de registros anadidos, incluidos los pendientes de volcar.
+     * @return Numero de registros.
+     */
+    [[nodiscard]] size_t cantidad() const {
+        return archivo_.cantidad();
+    }
+
+    /**
+     * @brief Devuelve la ruta del archivo del repositorio.
+     * @return Referencia constante a la cadena de ruta.
+     */
+    [[nodiscard]] const string &ruta() const {
+        return archivo_.ruta();
+    }
+
+    /**
+     * @brief Indica si el archivo no tiene registros.
+     * @return true cuando no hay historial persistido.
+     */
+    [[nodiscard]] bool vacio() const {
+        return archivo_.cantidad() == 0;
+    }
+
+private:
+    ArchivoRegistros archivo_;
+    ModoLectura modoLectura_ = ModoLectura::Mapeado;
+
+    /**
+     * @brief Convierte un archivo del formato 1 al formato 2.
+     */
+    void migrarFormatoAnterior() {
+        if (!archivo_.tieneFormatoAnterior()) {
+            return;
+        }
+        string bytes;
+        uint64_t cantidad = 0;
+        {
+            const ArchivoMapeado archivo(archivo_.ruta());
+            LectorBinario lector(archivo.contenido());
+            VistaRegistroHistorial vista;
+            while (lector.quedanDatos() && leerVistaRegistroHistorialV1(lector, vista)) {
+                escribirRegistroHistorial(bytes, vista);
+                ++cantidad;
+            }
+        }
+        ArchivoRegistros::reemplazar(archivo_.ruta(), kFirmaHistorial, 0U, bytes, cantidad);
+    }
+};
+
+/**
+ * @brief Enumeracion de las variables de clasificacion disponibles.
+ */
+enum class VariableClasificacion {
+    Genero = 0,
+    Residencia,
+    TipoColegio,
+    RangoEdad,
+    RangoPromedio,
+    RangoAprobacion,
+    Trabaja,
+    EstadoCivil,
+    ColegioProcedencia
+};
+
+/**
+ * @brief Cantidad de variables de clasificacion definidas.
+ */
+constexpr size_t kCantidadVariables = 9;
+
+/**
+ * @brief Devuelve el nombre legible de una variable de clasificacion.
+ * @param variable Variable que se desea describir.
+ * @return Nombre descriptivo para mostrar.
+ */
+string variableComoCadena(VariableClasificacion variable) {
+    switch (variable) {
+        case VariableClasificacion::Genero:
+            return "Genero";
+        case VariableClasificacion::Residencia:
+            return "Lugar de residencia";
+        case VariableClasificacion::TipoColegio:
+            return "Tipo de colegio";
+        case VariableClasificacion::RangoEdad:
             return "Rango de edad";
         case VariableClasificacion::RangoPromedio:
-            return "Promedio de notas";
+            return "Promedio de notas";
+        case VariableClasificacion::RangoAprobacion:
+            return "Porcentaje de aprobacion";
+        case VariableClasificacion::Trabaja:
+            return "Trabaja";
+        case VariableClasificacion::EstadoCivil:
+            return "Estado civil";
+        case VariableClasificacion::ColegioProcedencia:
+            return "Colegio de procedencia";
+        default:
+            return "Variable desconocida";
+    }
+}
+
+/**
+ * @brief Devuelve el nombre compacto de una variable, usado en las consultas escritas.
+ * @param variable Variable de clasificacion.
+ * @return Identificador sin espacios.
+ */
+string variableComoIdentificador(VariableClasificacion variable) {
+    switch (variable) {
+        case VariableClasificacion::Genero:
+            return "Genero";
+        case VariableClasificacion::Residencia:
+            return "Residencia";
+        case VariableClasificacion::TipoColegio:
+            return "TipoColegio";
+        case VariableClasificacion::RangoEdad:
+            return "RangoEdad";
+        case VariableClasificacion::RangoPromedio:
+            return "RangoPromedio";
+        case VariableClasificacion::RangoAprobacion:
+            return "RangoAprobacion";
+        case VariableClasificacion::Trabaja:
+            return "Trabaja";
+        case VariableClasificacion::EstadoCivil:
+            return "EstadoCivil";
+        case VariableClasificacion::ColegioProcedencia:
+            return "ColegioProcedencia";
+        default:
+            return "Desconocida";
+    }
+}
+
+/**
+ * @brief Busca una variable por su identificador o por su nombre legible, sin distinguir mayusculas.
+ * @param nombre Nombre escrito por el usuario.
+ * @return Variable encontrada o nullopt.
+ */
+optional<VariableClasificacion> variableDesdeNombre(const string &nombre) {
+    const auto buscado = aMayusculas(recortar(nombre));
+    for (size_t indice = 0; indice < kCantidadVariables; ++indice) {
+        const auto variable = static_cast<VariableClasificacion>(indice);
+        if (buscado == aMayusculas(variableComoIdentificador(variable)) ||
+            buscado == aMayusculas(variableComoCadena(variable))) {
+            return variable;
+        }
+    }
+    return nullopt;
+}
+
+/**
+ * @brief Devuelve el rango etiquetado para un valor de edad.
+ * @param age Edad en anos.
+ * @return Descripcion del rango.
+ */
+string rangoEdad(int edad) {
+    if (edad <= 0) {
+        return "Edad desconocida";
+    }
+    if (edad < 18) {
+        return "Menor a 18";
+    }
+    if (edad <= 30) {
+        return "18-30";
+    }
+    if (edad <= 64) {
+        return "31-64";
+    }
+    return "65+";
+}
+
+/**
+ * @brief Devuelve una etiqueta que describe el rango del promedio de notas.
+ * @param promedio Promedio de notas expresado de 0 a 100.
+ * @return Etiqueta del rango o "Sin historial" si no hay datos.
+ */
+string rangoPromedio(const optional<double> &promedio) {
+    if (!promedio.has_value()) {
+        return "Sin historial";
+    }
+    const double valor = clamp(promedio.value(), 0.0, 100.0);
+    if (valor < 60.0) {
+        return "0-59";
+    }
+    if (valor < 80.0) {
+        return "60-79";
+    }
+    return "80-100";
+}
+
+/**
+ * @brief Devuelve una etiqueta que describe el rango del porcentaje de aprobacion.
+ * @param tasaAprobacion Proporcion de aprobacion como fraccion entre 0 y 1.
+ * @return Etiqueta del rango o "Sin historial" si no hay datos.
+ */
+string rangoAprobacion(const optional<double> &tasaAprobacion) {
+    if (!tasaAprobacion.has_value()) {
+        return "Sin historial";
+    }
+    const double porcentaje = clamp(tasaAprobacion.value() * 100.0, 0.0, 100.0);
+    if (porcentaje <= 50.0) {
+        return "0-50 %";
+    }
+    if (porcentaje <= 75.0) {
+        return "51-75 %";
+    }
+    return "76-100 %";
+}
+
+/**
+ * @brief Diccionario que asigna un identificador compacto a cada cadena distinta.
+ */
+class DiccionarioCadenas {
+public:
+    DiccionarioCadenas() = default;
+    DiccionarioCadenas(DiccionarioCadenas &&) = default;
+    DiccionarioCadenas &operator=(DiccionarioCadenas &&) = default;
+    // Una copia dejaria las claves del mapa apuntando a las cadenas del original.
+    DiccionarioCadenas(const DiccionarioCadenas &) = delete;
+    DiccionarioCadenas &operator=(const DiccionarioCadenas &) = delete;
+
+    /**
+     * @brief Devuelve el identificador de una cadena, registrandola si aun no existe.
+     * @param valor Cadena a internar.
+     * @return Identificador estable de la cadena.
+     */
+    uint32_t registrar(string_view valor) {
+        if (const auto it = ids_.find(valor); it != ids_.end()) {
+            return it->second;
+        }
+        const auto id = static_cast<uint32_t>(valores_.size());
+        valores_.emplace_back(valor);
+        ids_.emplace(valores_.back(), id);
+        CONTAR(ContadorMedido::CadenasCreadas, 1U);
+        return id;
+    }
+
+    /**
+     * @brief Busca el identificador de una cadena sin registrarla.
+     * @param valor Cadena buscada.
+     * @return Identificador o nullopt si la cadena no fue registrada.
+     */
+    [[nodiscard]] optional<uint32_t> buscar(string_view valor) const {
+        if (const auto it = ids_.find(valor); it != ids_.end()) {
+            return it->second;
+        }
+        return nullopt;
+    }
+
+    /**
+     * @brief Devuelve la cadena asociada a un identificador.
+     * @param id Identificador devuelto por registrar.
+     * @return Referencia constante a la cadena.
+     */
+    [[nodiscard]] const string &valor(uint32_t id) const {
+        return valores_[id];
+    }
+
+    /**
+     * @brief Devuelve la cantidad de cadenas distintas registradas.
+     * @return Numero de entradas del diccionario.
+     */
+    [[nodiscard]] size_t tamano() const {
+        return valores_.size();
+    }
+
+private:
+    // deque conserva la direccion de cada cadena, por lo que las claves string_view siguen validas.
+    deque<string> valores_;
+    unordered_map<string_view, uint32_t> ids_;
+};
+
+/**
+ * @brief Almacen columnar de perfiles de estudiantes con estadisticas derivadas del historial.
+ *
+ * Cada atributo se guarda en un vector contiguo indexado por estudiante; los atributos categoricos
+ * se codifican contra un diccionario propio y el historial se guarda en formato CSR: los registros
+ * del estudiante i ocupan [inicioHistorial_[i], inicioHistorial_[i + 1]) en las columnas de
+ * historial. Los registros anexados despues de la carga se agregan al final de esas columnas y se
+ * enlazan por estudiante en registrosAnexados_; promedio y tasa de aprobacion se mantienen con sumas
+ * acumuladas, por lo que un alta no requiere recargar los archivos.
+ */
+class AlmacenPerfiles {
+public:
+    /**
+     * @brief Reserva capacidad para la cantidad esperada de estudiantes.
+     * @param estudiantes Cantidad de estudiantes.
+     */
+    void reservar(size_t estudiantes) {
+        genero_.reserve(estudiantes);
+        residencia_.reserve(estudiantes);
+        edad_.reserve(estudiantes);
+        colegioProcedencia_.reserve(estudiantes);
+        tipoColegio_.reserve(estudiantes);
+        trabaja_.reserve(estudiantes);
+        estadoCivil_.reserve(estudiantes);
+        promedio_.reserve(estudiantes);
+        tasaAprobacion_.reserve(estudiantes);
+        sumaNotas_.reserve(estudiantes);
+        cantidadNotas_.reserve(estudiantes);
+        aprobadas_.reserve(estudiantes);
+        inicioHistorial_.reserve(estudiantes + 1);
+        indicePorCarne_.reserve(estudiantes);
+    }
+
+    /**
+     * @brief Anade un estudiante sin historial al final del almacen.
+     * @param registro Estudiante o VistaEstudiante con los datos demograficos.
+     * @return Indice asignado al estudiante.
+     */
+    template <typename Registro>
+    size_t agregarEstudiante(const Registro &registro) {
+        const auto indice = carnes_.size();
+        carnes_.emplace_back(registro.carne);
+        CONTAR(ContadorMedido::CadenasCreadas, 1U);
+        genero_.push_back(generos_.registrar(registro.genero));
+        residencia_.push_back(residencias_.registrar(registro.residencia));
+        edad_.push_back(registro.edad);
+        colegioProcedencia_.push_back(colegios_.registrar(registro.colegioProcedencia));
+        tipoColegio_.push_back(tiposColegio_.registrar(registro.tipoColegio));
+        trabaja_.push_back(registro.trabaja ? 1U : 0U);
+        estadoCivil_.push_back(estadosCiviles_.registrar(registro.estadoCivil));
+        promedio_.push_back(kSinDato);
+        tasaAprobacion_.push_back(kSinDato);
+        sumaNotas_.push_back(0.0);
+        cantidadNotas_.push_back(0U);
+        aprobadas_.push_back(0U);
+        inicioHistorial_.push_back(inicioHistorial_.back());
+        // Con carnes repetidos el historial se asocia al primer estudiante, igual que antes.
+        indicePorCarne_.emplace(carnes_.back(), indice);
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            codificar(static_cast<VariableClasificacion>(variable), indice);
+        }
+        return indice;
+    }
+
+    /**
+     * @brief Reemplaza el historial de todos los estudiantes y recalcula sus estadisticas.
+     * @param estudiantes Indice del estudiante dueno de cada registro, en orden de archivo.
+     * @param semestres Semestre de cada registro.
+     * @param materias Identificador de materia (ver registrarMateria) de cada registro.
+     * @param notas Nota de cada registro.
+     */
+    void asignarHistoriales(const vector<uint32_t> &estudiantes, const vector<int> &semestres,
+                            const vector<uint32_t> &materias, const vector<double> &notas) {
+        const auto cantidadEstudiantes = carnes_.size();
+        fill(inicioHistorial_.begin(), inicioHistorial_.end(), 0U);
+        for (const auto estudiante : estudiantes) {
+            ++inicioHistorial_[estudiante + 1];
+        }
+        for (size_t i = 0; i < cantidadEstudiantes; ++i) {
+            inicioHistorial_[i + 1] += inicioHistorial_[i];
+        }
+
+        // Ordenamiento por conteo estable: conserva el orden del archivo dentro de cada estudiante.
+        vector<uint32_t> siguiente(inicioHistorial_.begin(), inicioHistorial_.end() - 1);
+        semestre_.assign(estudiantes.size(), 0);
+        materia_.assign(estudiantes.size(), 0U);
+        nota_.assign(estudiantes.size(), 0.0);
+        for (size_t registro = 0; registro < estudiantes.size(); ++registro) {
+            const auto destino = siguiente[estudiantes[registro]]++;
+            semestre_[destino] = semestres[registro];
+            materia_[destino] = materias[registro];
+            nota_[destino] = notas[registro];
+        }
+
+        registrosAnexados_.clear();
+        for (size_t i = 0; i < cantidadEstudiantes; ++i) {
+            recalcularEstadisticas(i);
+            codificar(VariableClasificacion::RangoPromedio, i);
+            codificar(VariableClasificacion::RangoAprobacion, i);
+        }
+    }
+
+    /**
+     * @brief Reemplaza el historial por sumas y conteos por estudiante, sin guardar los registros.
+     * @param recorrido Funcion invocada como recorrido(acumular); debe llamar acumular(indice, nota)
+     *        una vez por registro, en el orden del archivo.
+     */
+    template <typename Recorrido>
+    void asignarAgregados(Recorrido &&recorrido) {
+        inicioHistorial_.assign(carnes_.size() + 1, 0U);
+        vector<int>().swap(semestre_);
+        vector<uint32_t>().swap(materia_);
+        vector<double>().swap(nota_);
+        registrosAnexados_.clear();
+        historialEnMemoria_ = false;
+        for (size_t i = 0; i < carnes_.size(); ++i) {
+            recalcularEstadisticas(i);
+        }
+        recorrido([this](size_t indice, double nota) { acumularNota(indice, nota); });
+        for (size_t i = 0; i < carnes_.size(); ++i) {
+            codificar(VariableClasificacion::RangoPromedio, i);
+            codificar(VariableClasificacion::RangoAprobacion, i);
+        }
+    }
+
+    /**
+     * @brief Anexa un registro de historial a su estudiante y actualiza sus estadisticas.
+     * @param registro Registro recien persistido.
+     * @return Indice del estudiante actualizado o nullopt si el carne no esta en el almacen.
+     */
+    optional<size_t> agregarRegistro(const RegistroHistorial &registro) {
+        const auto indice = buscarIndice(registro.carneEstudiante);
+        if (!indice.has_value()) {
+            return nullopt;
+        }
+        if (!historialEnMemoria_) {
+            acumularNota(indice.value(), registro.nota);
+            codificar(VariableClasificacion::RangoPromedio, indice.value());
+            codificar(VariableClasificacion::RangoAprobacion, indice.value());
+            return indice;
+        }
+        registrosAnexados_[indice.value()].push_back(static_cast<uint32_t>(nota_.size()));
+        semestre_.push_back(registro.semestre);
+        materia_.push_back(materias_.registrar(registro.materia));
+        nota_.push_back(registro.nota);
+        acumularNota(indice.value(), registro.nota);
+        codificar(VariableClasificacion::RangoPromedio, indice.value());
+        codificar(VariableClasificacion::RangoAprobacion, indice.value());
+        return indice;
+    }
+
+    /**
+     * @brief Registra el nombre de una materia en el diccionario de materias.
+     * @param materia Nombre de la materia.
+     * @return Identificador de la materia.
+     */
+    uint32_t registrarMateria(string_view materia) {
+        return materias_.registrar(materia);
+    }
+
+    /**
+     * @brief Busca el indice de un estudiante por su carne.
+     * @param carne Carne buscado.
+     * @return Indice del estudiante o nullopt si no existe.
+     */
+    [[nodiscard]] optional<size_t> buscarIndice(string_view carne) const {
+        if (const auto it = indicePorCarne_.find(carne); it != indicePorCarne_.end()) {
+            return it->second;
+        }
+        return nullopt;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes almacenados.
+     * @return Numero de perfiles.
+     */
+    [[nodiscard]] size_t cantidad() const {
+        return carnes_.size();
+    }
+
+    /**
+     * @brief Indica si el almacen no contiene estudiantes.
+     * @return true cuando no hay perfiles.
+     */
+    [[nodiscard]] bool vacio() const {
+        return carnes_.empty();
+    }
+
+    /**
+     * @brief Devuelve el carne del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] const string &carne(size_t i) const {
+        return carnes_[i];
+    }
+
+    /**
+     * @brief Devuelve el genero del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] const string &genero(size_t i) const {
+        return generos_.valor(genero_[i]);
+    }
+
+    /**
+     * @brief Devuelve el lugar de residencia del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] const string &residencia(size_t i) const {
+        return residencias_.valor(residencia_[i]);
+    }
+
+    /**
+     * @brief Devuelve la edad del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] int edad(size_t i) const {
+        return edad_[i];
+    }
+
+    /**
+     * @brief Devuelve el colegio de procedencia del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] const string &colegioProcedencia(size_t i) const {
+        return colegios_.valor(colegioProcedencia_[i]);
+    }
+
+    /**
+     * @brief Devuelve el tipo de colegio del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] const string &tipoColegio(size_t i) const {
+        return tiposColegio_.valor(tipoColegio_[i]);
+    }
+
+    /**
+     * @brief Indica si el estudiante indicado trabaja.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] bool trabaja(size_t i) const {
+        return trabaja_[i] != 0;
+    }
+
+    /**
+     * @brief Devuelve el estado civil del estudiante indicado.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] const string &estadoCivil(size_t i) const {
+        return estadosCiviles_.valor(estadoCivil_[i]);
+    }
+
+    /**
+     * @brief Devuelve el promedio de notas o nullopt si no hay historial.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] optional<double> promedio(size_t i) const {
+        return isnan(promedio_[i]) ? nullopt : optional<double>(promedio_[i]);
+    }
+
+    /**
+     * @brief Devuelve la tasa de aprobacion (0 a 1) o nullopt si no hay historial.
+     * @param i Indice del estudiante.
+     */
+    [[nodiscard]] optional<double> tasaAprobacion(size_t i) const {
+        return isnan(tasaAprobacion_[i]) ? nullopt : optional<double>(tasaAprobacion_[i]);
+    }
+
+    /**
+     * @brief Devuelve la columna de codigos de categoria de una variable, uno por estudiante.
+     * @param variable Variable de clasificacion.
+     * @return Referencia constante a la columna.
+     */
+    [[nodiscard]] const vector<uint16_t> &codigos(VariableClasificacion variable) const {
+        return clasificacion_[static_cast<size_t>(variable)].codigos;
+    }
+
+    /**
+     * @brief Devuelve el codigo de categoria de un estudiante para una variable.
+     * @param variable Variable de clasificacion.
+     * @param i Indice del estudiante.
+     * @return Codigo de la etiqueta del estudiante.
+     */
+    [[nodiscard]] uint16_t codigo(VariableClasificacion variable, size_t i) const {
+        return codigos(variable)[i];
+    }
+
+    /**
+     * @brief Devuelve la etiqueta asociada a un codigo de categoria.
+     * @param variable Variable de clasificacion.
+     * @param codigo Codigo de categoria.
+     * @return Etiqueta de clasificacion.
+     */
+    [[nodiscard]] const string &etiqueta(VariableClasificacion variable, uint16_t codigo) const {
+        return clasificacion_[static_cast<size_t>(variable)].etiquetas.valor(codigo);
+    }
+
+    /**
+     * @brief Devuelve la cantidad de etiquetas distintas registradas para una variable.
+     * @param variable Variable de clasificacion.
+     * @return Numero de codigos validos.
+     */
+    [[nodiscard]] size_t cantidadCategorias(VariableClasificacion variable) const {
+        return clasificacion_[static_cast<size_t>(variable)].etiquetas.tamano();
+    }
+
+    /**
+     * @brief Devuelve los codigos de una variable ordenados alfabeticamente por etiqueta.
+     * @param variable Variable de clasificacion.
+     * @return Codigos en el orden en que deben aparecer los nodos hermanos.
+     */
+    [[nodiscard]] const vector<uint16_t> &codigosEnOrden(VariableClasificacion variable) const {
+        return clasificacion_[static_cast<size_t>(variable)].enOrden;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de registros de historial de un estudiante.
+     * @param i Indice del estudiante.
+     * @return Numero de registros.
+     */
+    [[nodiscard]] size_t cantidadHistorial(size_t i) const {
+        return cantidadNotas_[i];
+    }
+
+    /**
+     * @brief Indica si los registros de historial estan en memoria o solo sus acumulados.
+     * @return false despues de asignarAgregados; el historial debe leerse del archivo.
+     */
+    [[nodiscard]] bool historialEnMemoria() const {
+        return historialEnMemoria_;
+    }
+
+    /**
+     * @brief Recorre el historial de un estudiante en el orden en que fue registrado.
+     *
+     * No visita nada si el almacen solo guarda acumulados (ver historialEnMemoria).
+     * @param i Indice del estudiante.
+     * @param visitar Funcion invocada como visitar(semestre, materia, nota).
+     */
+    template <typename Visitante>
+    void recorrerHistorial(size_t i, Visitante &&visitar) const {
+        for (auto registro = inicioHistorial_[i]; registro < inicioHistorial_[i + 1]; ++registro) {
+            visitar(semestre_[registro], materias_.valor(materia_[registro]), nota_[registro]);
+        }
+        if (const auto it = registrosAnexados_.find(i); it != registrosAnexados_.end()) {
+            for (const auto registro : it->second) {
+                visitar(semestre_[registro], materias_.valor(materia_[registro]), nota_[registro]);
+            }
+        }
+    }
+
+private:
+    static constexpr double kSinDato = numeric_limits<double>::quiet_NaN();
+
+    DiccionarioCadenas generos_;
+    DiccionarioCadenas residencias_;
+    DiccionarioCadenas colegios_;
+    DiccionarioCadenas tiposColegio_;
+    DiccionarioCadenas estadosCiviles_;
+    DiccionarioCadenas materias_;
+
+    // deque conserva la direccion de cada carne; indicePorCarne_ usa vistas sobre ellos.
+    deque<string> carnes_;
+    vector<uint32_t> genero_;
+    vector<uint32_t> residencia_;
+    vector<int> edad_;
+    vector<uint32_t> colegioProcedencia_;
+    vector<uint32_t> tipoColegio_;
+    vector<uint8_t> trabaja_;
+    vector<uint32_t> estadoCivil_;
+    vector<double> promedio_;
+    vector<double> tasaAprobacion_;
+    vector<double> sumaNotas_;
+    vector<uint32_t> cantidadNotas_;
+    vector<uint32_t> aprobadas_;
+
+    vector<uint32_t> inicioHistorial_{0U};
+    vector<int> semestre_;
+    vector<uint32_t> materia_;
+    vector<double> nota_;
+    unordered_map<size_t, vector<uint32_t>> registrosAnexados_;
+    bool historialEnMemoria_ = true;
+
+    unordered_map<string_view, size_t> indicePorCarne_;
+
+    /**
+     * @brief Codificacion de una variable de clasificacion: diccionario de etiquetas, codigos en
+     *        orden alfabetico de etiqueta y el codigo de cada estudiante.
+     */
+    struct ColumnaClasificacion {
+        DiccionarioCadenas etiquetas;
+        vector<uint16_t> enOrden;
+        vector<uint16_t> codigos;
+    };
+    array<ColumnaClasificacion, kCantidadVariables> clasificacion_;
+
+    void codificar(VariableClasificacion variable, size_t i);
+
+    /**
+     * @brief Recalcula las sumas acumuladas de un estudiante a partir de su bloque CSR.
+     * @param i Indice del estudiante.
+     */
+    void recalcularEstadisticas(size_t i) {
+        sumaNotas_[i] = 0.0;
+        cantidadNotas_[i] = 0U;
+        aprobadas_[i] = 0U;
+        promedio_[i] = kSinDato;
+        tasaAprobacion_[i] = kSinDato;
+        for (auto registro = inicioHistorial_[i]; registro < inicioHistorial_[i + 1]; ++registro) {
+            acumularNota(i, nota_[registro]);
+        }
+    }
+
+    /**
+     * @brief Suma una nota a los acumulados del estudiante y actualiza promedio y aprobacion.
+     * @param i Indice del estudiante.
+     * @param nota Nota agregada.
+     */
+    void acumularNota(size_t i, double nota) {
+        sumaNotas_[i] += nota;
+        ++cantidadNotas_[i];
+        if (nota >= 70.0) {
+            ++aprobadas_[i];
+        }
+        const auto cantidadRegistros = static_cast<double>(cantidadNotas_[i]);
+        promedio_[i] = sumaNotas_[i] / cantidadRegistros;
+        tasaAprobacion_[i] = static_cast<double>(aprobadas_[i]) / cantidadRegistros;
+    }
+};
+
+/**
+ * @brief Empareja el historial de un archivo compactado con sus estudiantes mediante una reunion
+ *        por mezcla.
+ *
+ * Los estudiantes se recorren en orden de carne (casi siempre ya lo estan y solo se verifica) y el
+ * historial se lee en secuencia: cada registro se compara con el estudiante actual, sin buscar su
+ * carne en una tabla hash.
+ * @param perfiles Almacen con los estudiantes ya cargados.
+ * @param repositorioHistorial Repositorio cuyo archivo esta ordenado por carne.
+ * @param visitar Funcion invocada como visitar(indice, vista) por cada registro con estudiante.
+ */
+template <typename Visitante>
+void recorrerHistorialOrdenado(const AlmacenPerfiles &perfiles,
+                               const RepositorioHistorial &repositorioHistorial, Visitante &&visitar) {
+    vector<uint32_t> porCarne(perfiles.cantidad());
+    iota(porCarne.begin(), porCarne.end(), 0U);
+    const auto menorCarne = [&](uint32_t a, uint32_t b) {
+        return perfiles.carne(a) < perfiles.carne(b);
+    };
+    if (!is_sorted(porCarne.begin(), porCarne.end(), menorCarne)) {
+        sort(porCarne.begin(), porCarne.end(), menorCarne);
+    }
+    size_t actual = 0;
+    repositorioHistorial.recorrer([&](const VistaRegistroHistorial &vista) {
+        while (actual < porCarne.size() && perfiles.carne(porCarne[actual]) < vista.carneEstudiante) {
+            ++actual;
+        }
+        if (actual < porCarne.size() && perfiles.carne(porCarne[actual]) == vista.carneEstudiante) {
+            visitar(size_t{porCarne[actual]}, vista);
+        }
+    });
+}
+
+/**
+ * @brief Asigna el historial de un archivo compactado con recorrerHistorialOrdenado.
+ * @param perfiles Almacen con los estudiantes ya cargados.
+ * @param repositorioHistorial Repositorio cuyo archivo esta ordenado por carne.
+ */
+void asignarHistorialOrdenado(AlmacenPerfiles &perfiles,
+                              const RepositorioHistorial &repositorioHistorial) {
+    vector<uint32_t> estudiantes;
+    vector<int> semestres;
+    vector<uint32_t> materias;
+    vector<double> notas;
+    estudiantes.reserve(repositorioHistorial.cantidad());
+    semestres.reserve(repositorioHistorial.cantidad());
+    materias.reserve(repositorioHistorial.cantidad());
+    notas.reserve(repositorioHistorial.cantidad());
+    recorrerHistorialOrdenado(
+        perfiles, repositorioHistorial, [&](size_t indice, const VistaRegistroHistorial &vista) {
+            estudiantes.push_back(static_cast<uint32_t>(indice));
+            semestres.push_back(vista.semestre);
+            materias.push_back(perfiles.registrarMateria(vista.materia));
+            notas.push_back(vista.nota);
+        });
+    perfiles.asignarHistoriales(estudiantes, semestres, materias, notas);
+}
+
+/**
+ * @brief Cuanto historial conserva en memoria cargarPerfiles.
+ */
+enum class ModoCargaPerfiles {
+    Completa,     ///< Semestre, materia y nota de cada registro.
+    SoloAgregados ///< Solo suma, cantidad y aprobadas por estudiante; el detalle se lee del disco.
+};
+
+/**
+ * @brief Carga perfiles de estudiantes con estadisticas desde los repositorios.
+ *
+ * Los estudiantes se cargan en serie. Si el historial esta compactado se asigna con
+ * asignarHistorialOrdenado; si no, el historial, que es el archivo mas grande, se decodifica en
+ * tramos paralelos: cada tramo resuelve carnes contra el almacen (solo lectura) e interna materias
+ * en un diccionario propio; al concatenar los tramos en orden se traducen esos identificadores al
+ * diccionario global, con lo que el resultado es identico al de una carga serial.
+ *
+ * Con ModoCargaPerfiles::SoloAgregados el historial se recorre una vez acumulando solo los totales
+ * de cada estudiante, de modo que la memoria no crece con la cantidad de registros.
+ * @param repositorioEstudiantes Repositorio que suministra los registros de estudiantes.
+ * @param repositorioHistorial Repositorio que suministra los registros de historial.
+ * @param pool Pool de hilos usado para decodificar el historial.
+ * @param modo Cuanto historial se conserva en memoria.
+ * @return Almacen de perfiles con promedios y tasas de aprobacion calculadas.
+ */
+AlmacenPerfiles cargarPerfiles(const RepositorioEstudiantes &repositorioEstudiantes,
+                               const RepositorioHistorial &repositorioHistorial, PoolTrabajo &pool,
+                               ModoCargaPerfiles modo = ModoCargaPerfiles::Completa) {
+    AlmacenPerfiles perfiles;
+    perfiles.reservar(repositorioEstudiantes.cantidad());
+    repositorioEstudiantes.recorrer(
+        [&](const VistaEstudiante &vista) { perfiles.agregarEstudiante(vista); });
+    // Incluye la lectura del historial, que tambien se acumula en su propia fase.
+    MEDIR_FASE(FaseMedida::AgrupacionHistorial);
+    if (modo == ModoCargaPerfiles::SoloAgregados) {
+        perfiles.asignarAgregados([&](const auto &acumular) {
+            if (repositorioHistorial.ordenadoPorCarne()) {
+                recorrerHistorialOrdenado(perfiles, repositorioHistorial,
+                                          [&](size_t indice, const VistaRegistroHistorial &vista) {
+                                              acumular(indice, vista.nota);
+                                          });
+                return;
+            }
+            repositorioHistorial.recorrer([&](const VistaRegistroHistorial &vista) {
+                const auto indice = perfiles.buscarIndice(vista.carneEstudiante);
+                if (indice.has_value()) {
+                    acumular(indice.value(), vista.nota);
+                }
+            });
+        });
+        return perfiles;
+    }
+    if (repositorioHistorial.ordenadoPorCarne()) {
+        asignarHistorialOrdenado(perfiles, repositorioHistorial);
+        return perfiles;
+    }
+
+    struct Tramo {
+        vector<uint32_t> estudiantes;
+        vector<int> semestres;
+        vector<uint32_t> materias;
+        vector<double> notas;
+        DiccionarioCadenas materiasLocales;
+    };
+    const auto tramos =
+        repositorioHistorial.cantidad() >= kUmbralDecodificacionParalela ? pool.hilos() : size_t{1};
+    vector<Tramo> parciales(tramos);
+    repositorioHistorial.recorrerPorTramos(
+        pool, tramos, [&](size_t tramo, const VistaRegistroHistorial &vista) {
+            const auto indice = perfiles.buscarIndice(vista.carneEstudiante);
+            if (!indice.has_value()) {
+                return;
+            }
+            auto &parcial = parciales[tramo];
+            parcial.estudiantes.push_back(static_cast<uint32_t>(indice.value()));
+            parcial.semestres.push_back(vista.semestre);
+            parcial.materias.push_back(parcial.materiasLocales.registrar(vista.materia));
+            parcial.notas.push_back(vista.nota);
+        });
+
+    size_t total = 0;
+    for (const auto &parcial : parciales) {
+        total += parcial.estudiantes.size();
+    }
+    vector<uint32_t> estudiantes;
+    vector<int> semestres;
+    vector<uint32_t> materias;
+    vector<double> notas;
+    estudiantes.reserve(total);
+    semestres.reserve(total);
+    materias.reserve(total);
+    notas.reserve(total);
+    for (auto &parcial : parciales) {
+        vector<uint32_t> traduccion(parcial.materiasLocales.tamano());
+        for (uint32_t local = 0; local < traduccion.size(); ++local) {
+            traduccion[local] = perfiles.registrarMateria(parcial.materiasLocales.valor(local));
+        }
+        estudiantes.insert(estudiantes.end(), parcial.estudiantes.begin(), parcial.estudiantes.end());
+        semestres.insert(semestres.end(), parcial.semestres.begin(), parcial.semestres.end());
+        for (const auto local : parcial.materias) {
+            materias.push_back(traduccion[local]);
+        }
+        notas.insert(notas.end(), parcial.notas.begin(), parcial.notas.end());
+        parcial = Tramo();
+    }
+    perfiles.asignarHistoriales(estudiantes, semestres, materias, notas);
+    return perfiles;
+}
+
+/**
+ * @brief Calcula la etiqueta de clasificacion de una variable usando el perfil del estudiante.
+ * @param variable Variable objetivo.
+ * @param perfiles Almacen que contiene los datos.
+ * @param indice Indice del estudiante dentro del almacen.
+ * @return Etiqueta de clasificacion.
+ */
+string valorClasificacion(VariableClasificacion variable, const AlmacenPerfiles &perfiles,
+                          size_t indice) {
+    switch (variable) {
+        case VariableClasificacion::Genero:
+            return perfiles.genero(indice).empty() ? "Sin registro" : perfiles.genero(indice);
+        case VariableClasificacion::Residencia:
+            return perfiles.residencia(indice).empty() ? "Sin registro" : perfiles.residencia(indice);
+        case VariableClasificacion::TipoColegio:
+            return perfiles.tipoColegio(indice).empty() ? "Sin registro" : perfiles.tipoColegio(indice);
+        case VariableClasificacion::RangoEdad:
+            return rangoEdad(perfiles.edad(indice));
+        case VariableClasificacion::RangoPromedio:
+            return rangoPromedio(perfiles.promedio(indice));
         case VariableClasificacion::RangoAprobacion:
-            return "Porcentaje de aprobacion";
+            return rangoAprobacion(perfiles.tasaAprobacion(indice));
         case VariableClasificacion::Trabaja:
-            return "Trabaja";
+            return perfiles.trabaja(indice) ? "Si" : "No";
         case VariableClasificacion::EstadoCivil:
-            return "Estado civil";
+            return perfiles.estadoCivil(indice).empty() ? "Sin registro" : perfiles.estadoCivil(indice);
         case VariableClasificacion::ColegioProcedencia:
-            return "Colegio de procedencia";
+            return perfiles.colegioProcedencia(indice).empty() ? "Sin registro"
+                                                               : perfiles.colegioProcedencia(indice);
         default:
-            return "Variable desconocida";
+            return "Desconocido";
+    }
+}
+
+/**
+ * @brief Calcula y guarda el codigo de categoria de un estudiante para una variable.
+ * @param variable Variable de clasificacion.
+ * @param i Indice del estudiante.
+ * @throws runtime_error si la variable supera la cantidad de etiquetas representable.
+ */
+void AlmacenPerfiles::codificar(VariableClasificacion variable, size_t i) {
+    auto &columna = clasificacion_[static_cast<size_t>(variable)];
+    const auto etiqueta = valorClasificacion(variable, *this, i);
+    const auto id = columna.etiquetas.registrar(etiqueta);
+    if (id > numeric_limits<uint16_t>::max()) {
+        throw runtime_error("Demasiadas categorias distintas para " + variableComoCadena(variable) +
+                            ".");
+    }
+    const auto codigo = static_cast<uint16_t>(id);
+    if (columna.enOrden.size() < columna.etiquetas.tamano()) {
+        const auto posicion = lower_bound(columna.enOrden.begin(), columna.enOrden.end(), etiqueta,
+                                          [&](uint16_t existente, const string &valor) {
+                                              return columna.etiquetas.valor(existente) < valor;
+                                          });
+        columna.enOrden.insert(posicion, codigo);
+    }
+    if (i < columna.codigos.size()) {
+        columna.codigos[i] = codigo;
+    } else {
+        columna.codigos.push_back(codigo);
+    }
+}
+
+/**
+ * @brief Nodo del arbol de clasificacion que almacena indices de estudiantes y relaciones jerarquicas.
+ */
+struct NodoArbolClasificacion {
+    string etiqueta;
+    optional<VariableClasificacion> variable;
+    vector<size_t> indicesEstudiantes;
+    vector<unique_ptr<NodoArbolClasificacion>> hijos;
+    NodoArbolClasificacion *padre = nullptr;
+    size_t nivel = 0;
+};
+
+/**
+ * @brief Grupo de estudiantes que comparten el codigo de categoria de una variable.
+ */
+struct GrupoClasificacion {
+    uint16_t codigo = 0;
+    vector<size_t> indices;
+};
+
+/**
+ * @brief Agrupa un rango de indices de estudiantes segun el codigo de categoria de una variable.
+ *
+ * Hace un conteo por codigo y luego reparte los indices en grupos de tamano exacto, sin calcular
+ * ni comparar etiquetas de texto.
+ * @param perfiles Perfiles de estudiantes utilizados para agrupar.
+ * @param variable Variable que define los grupos.
+ * @param inicio Primer indice del rango.
+ * @param fin Posicion siguiente al ultimo indice del rango.
+ * @return Grupos ordenados por etiqueta; cada grupo conserva el orden del rango.
+ */
+vector<GrupoClasificacion> agruparIndices(const AlmacenPerfiles &perfiles,
+                                          VariableClasificacion variable, const size_t *inicio,
+                                          const size_t *fin) {
+    const auto &codigos = perfiles.codigos(variable);
+    vector<size_t> conteos(perfiles.cantidadCategorias(variable), 0U);
+    for (auto actual = inicio; actual != fin; ++actual) {
+        ++conteos[codigos[*actual]];
+    }
+
+    vector<GrupoClasificacion> grupos;
+    vector<size_t> grupoPorCodigo(conteos.size(), 0U);
+    for (const auto codigo : perfiles.codigosEnOrden(variable)) {
+        if (conteos[codigo] == 0) {
+            continue;
+        }
+        grupoPorCodigo[codigo] = grupos.size();
+        auto &grupo = grupos.emplace_back();
+        grupo.codigo = codigo;
+        grupo.indices.reserve(conteos[codigo]);
+    }
+    for (auto actual = inicio; actual != fin; ++actual) {
+        grupos[grupoPorCodigo[codigos[*actual]]].indices.push_back(*actual);
+    }
+    return grupos;
+}
+
+/**
+ * @brief Crea un hijo por grupo, en el orden de las etiquetas.
+ * @param nodo Nodo padre.
+ * @param perfiles Perfiles que proveen las etiquetas de cada codigo.
+ * @param variable Variable del nivel de los hijos.
+ * @param grupos Grupos de indices; sus vectores se mueven a los hijos.
+ */
+void anexarHijos(NodoArbolClasificacion &nodo, const AlmacenPerfiles &perfiles,
+                 VariableClasificacion variable, vector<GrupoClasificacion> &grupos) {
+    nodo.hijos.reserve(grupos.size());
+    CONTAR_NODOS(nodo.nivel + 1, grupos.size());
+    CONTAR(ContadorMedido::CadenasCreadas, grupos.size());
+    for (auto &grupo : grupos) {
+        auto hijo = make_unique<NodoArbolClasificacion>();
+        hijo->etiqueta = perfiles.etiqueta(variable, grupo.codigo);
+        hijo->variable = variable;
+        hijo->indicesEstudiantes = move(grupo.indices);
+        hijo->padre = &nodo;
+        hijo->nivel = nodo.nivel + 1;
+        nodo.hijos.push_back(move(hijo));
+    }
+}
+
+/**
+ * @brief Construye el arbol de clasificacion de forma recursiva.
+ * @param nodo Nodo cuyos hijos seran poblados.
+ * @param perfiles Perfiles de estudiantes utilizados para agrupar.
+ * @param orden Secuencia de variables de clasificacion.
+ */
+void construirArbolRecursivo(NodoArbolClasificacion &nodo, const AlmacenPerfiles &perfiles,
+                             const vector<VariableClasificacion> &orden) {
+    if (nodo.nivel >= orden.size()) {
+        return;
+    }
+
+    {
+        MEDIR_NIVEL(nodo.nivel);
+        const auto variable = orden[nodo.nivel];
+        const auto &indices = nodo.indicesEstudiantes;
+        auto grupos =
+            agruparIndices(perfiles, variable, indices.data(), indices.data() + indices.size());
+        anexarHijos(nodo, perfiles, variable, grupos);
+    }
+    for (auto &hijo : nodo.hijos) {
+        construirArbolRecursivo(*hijo, perfiles, orden);
+    }
+}
+
+/**
+ * @brief Construye el arbol de clasificacion usando el orden de variables indicado.
+ * @param perfiles Perfiles de estudiantes que participan en el arbol.
+ * @param orden Secuencia de variables de clasificacion (niveles).
+ * @return Puntero al nodo raiz.
+ */
+unique_ptr<NodoArbolClasificacion>
+construirArbolClasificacion(const AlmacenPerfiles &perfiles,
+                            const vector<VariableClasificacion> &orden) {
+    auto raiz = make_unique<NodoArbolClasificacion>();
+    raiz->etiqueta = "Poblacion total";
+    raiz->nivel = 0;
+    CONTAR_NODOS(0U, 1U);
+    raiz->indicesEstudiantes.reserve(perfiles.cantidad());
+    for (size_t indice = 0; indice < perfiles.cantidad(); ++indice) {
+        raiz->indicesEstudiantes.push_back(indice);
+    }
+    construirArbolRecursivo(*raiz, perfiles, orden);
+    return raiz;
+}
+
+/**
+ * @brief Construye el arbol de clasificacion solo con los estudiantes de una muestra.
+ * @param perfiles Perfiles de estudiantes utilizados para agrupar.
+ * @param orden Secuencia de variables de clasificacion (niveles).
+ * @param muestra Indices de los estudiantes muestreados, en orden creciente.
+ * @return Puntero al nodo raiz; sus conteos son conteos de la muestra.
+ */
+unique_ptr<NodoArbolClasificacion>
+construirArbolMuestra(const AlmacenPerfiles &perfiles, const vector<VariableClasificacion> &orden,
+                      const vector<size_t> &muestra) {
+    auto raiz = make_unique<NodoArbolClasificacion>();
+    raiz->etiqueta = "Poblacion total";
+    raiz->nivel = 0;
+    CONTAR_NODOS(0U, 1U);
+    raiz->indicesEstudiantes = muestra;
+    construirArbolRecursivo(*raiz, perfiles, orden);
+    return raiz;
+}
+
+/**
+ * @brief Nodos con menos estudiantes que este umbral se construyen en serie dentro de una tarea.
+ */
+constexpr size_t kUmbralConstruccionParalela = 4096;
+
+/**
+ * @brief Cantidad de arboles planos que conserva la cache de la aplicacion.
+ */
+constexpr size_t kCapacidadCacheArboles = 4;
+
+/**
+ * @brief Celdas maximas del cubo de conteos, contando la posicion de total de cada dimension.
+ */
+constexpr size_t kMaximoCeldasCubo = size_t{1} << 22;
+
+/**
+ * @brief Celdas maximas que suman los histogramas parciales de una construccion paralela del cubo.
+ */
+constexpr size_t kMaximoCeldasParcialesCubo = size_t{1} << 24;
+
+/**
+ * @brief Construye el subarbol de un nodo encolando cada hijo grande como una tarea del pool.
+ * @param nodo Nodo cuyos hijos seran poblados.
+ * @param perfiles Perfiles de estudiantes utilizados para agrupar.
+ * @param orden Secuencia de variables de clasificacion.
+ * @param pool Pool donde se encolan los subarboles.
+ * @param umbral Tamano minimo de un nodo para construir sus hijos en tareas separadas.
+ */
+void construirSubarbolParalelo(NodoArbolClasificacion &nodo, const AlmacenPerfiles &perfiles,
+                               const vector<VariableClasificacion> &orden, PoolTrabajo &pool,
+                               size_t umbral) {
+    if (nodo.indicesEstudiantes.size() < umbral) {
+        construirArbolRecursivo(nodo, perfiles, orden);
+        return;
+    }
+    if (nodo.nivel >= orden.size()) {
+        return;
+    }
+    {
+        MEDIR_NIVEL(nodo.nivel);
+        const auto variable = orden[nodo.nivel];
+        const auto &indices = nodo.indicesEstudiantes;
+        auto grupos =
+            agruparIndices(perfiles, variable, indices.data(), indices.data() + indices.size());
+        // Los hijos se crean antes de encolar, asi su orden no depende de cuando termine cada tarea.
+        anexarHijos(nodo, perfiles, variable, grupos);
+    }
+    for (auto &hijo : nodo.hijos) {
+        pool.encolar([&perfiles, &orden, &pool, umbral, destino = hijo.get()] {
+            construirSubarbolParalelo(*destino, perfiles, orden, pool, umbral);
+        });
+    }
+}
+
+/**
+ * @brief Construye el arbol de clasificacion repartiendo el trabajo entre los hilos de un pool.
+ *
+ * El primer nivel se agrupa por bloques contiguos de la raiz, uno por hilo, y los grupos parciales
+ * se concatenan en orden de bloque; despues cada subarbol se construye como tarea independiente.
+ * El resultado es identico al de construirArbolClasificacion, incluido el orden de los hijos.
+ * @param perfiles Perfiles de estudiantes que participan en el arbol.
+ * @param orden Secuencia de variables de clasificacion (niveles).
+ * @param pool Pool de hilos que ejecuta la construccion.
+ * @param umbral Nodos con menos estudiantes se construyen en serie.
+ * @return Puntero al nodo raiz.
+ */
+unique_ptr<NodoArbolClasificacion>
+construirArbolClasificacionParalelo(const AlmacenPerfiles &perfiles,
+                                    const vector<VariableClasificacion> &orden, PoolTrabajo &pool,
+                                    size_t umbral = kUmbralConstruccionParalela) {
+    const auto total = perfiles.cantidad();
+    if (orden.empty() || total < umbral) {
+        return construirArbolClasificacion(perfiles, orden);
+    }
+    auto raiz = make_unique<NodoArbolClasificacion>();
+    raiz->etiqueta = "Poblacion total";
+    raiz->nivel = 0;
+    CONTAR_NODOS(0U, 1U);
+    raiz->indicesEstudiantes.resize(total);
+    iota(raiz->indicesEstudiantes.begin(), raiz->indicesEstudiantes.end(), size_t{0});
+
+    {
+        MEDIR_NIVEL(0U);
+        const auto bloques = pool.hilos();
+        const auto *indices = raiz->indicesEstudiantes.data();
+        vector<vector<GrupoClasificacion>> parciales(bloques);
+        for (size_t bloque = 0; bloque < bloques; ++bloque) {
+            pool.encolar([&, bloque] {
+                parciales[bloque] =
+                    agruparIndices(perfiles, orden.front(), indices + total * bloque / bloques,
+                                   indices + total * (bloque + 1) / bloques);
+            });
+        }
+        pool.esperar();
+
+        vector<vector<size_t>> indicesPorCodigo(perfiles.cantidadCategorias(orden.front()));
+        for (auto &parcial : parciales) {
+            for (auto &grupo : parcial) {
+                auto &destino = indicesPorCodigo[grupo.codigo];
+                destino.insert(destino.end(), grupo.indices.begin(), grupo.indices.end());
+            }
+        }
+        vector<GrupoClasificacion> grupos;
+        for (const auto codigo : perfiles.codigosEnOrden(orden.front())) {
+            if (!indicesPorCodigo[codigo].empty()) {
+                grupos.push_back({codigo, move(indicesPorCodigo[codigo])});
+            }
+        }
+        anexarHijos(*raiz, perfiles, orden.front(), grupos);
+    }
+    for (auto &hijo : raiz->hijos) {
+        pool.encolar([&perfiles, &orden, &pool, umbral, destino = hijo.get()] {
+            construirSubarbolParalelo(*destino, perfiles, orden, pool, umbral);
+        });
+    }
+    pool.esperar();
+    return raiz;
+}
+
+/**
+ * @brief Calcula las etiquetas que ubican a un estudiante en cada nivel del arbol.
+ * @param perfiles Almacen de perfiles.
+ * @param orden Secuencia de variables de clasificacion.
+ * @param indice Indice del estudiante.
+ * @return Una etiqueta por nivel, en el mismo orden que las variables.
+ */
+vector<string> etiquetasClasificacion(const AlmacenPerfiles &perfiles,
+                                      const vector<VariableClasificacion> &orden, size_t indice) {
+    vector<string> etiquetas;
+    etiquetas.reserve(orden.size());
+    for (const auto variable : orden) {
+        etiquetas.push_back(perfiles.etiqueta(variable, perfiles.codigo(variable, indice)));
+    }
+    return etiquetas;
+}
+
+/**
+ * @brief Busca el hijo con la etiqueta indicada; los hijos se mantienen ordenados por etiqueta.
+ * @param nodo Nodo padre.
+ * @param etiqueta Etiqueta buscada.
+ * @return Iterador al hijo o a la posicion donde deberia insertarse.
+ */
+vector<unique_ptr<NodoArbolClasificacion>>::iterator
+posicionHijo(NodoArbolClasificacion &nodo, const string &etiqueta) {
+    return lower_bound(nodo.hijos.begin(), nodo.hijos.end(), etiqueta,
+                       [](const unique_ptr<NodoArbolClasificacion> &hijo, const string &valor) {
+                           return hijo->etiqueta < valor;
+                       });
+}
+
+/**
+ * @brief Inserta un indice en una lista ordenada de indices de estudiantes.
+ * @param indices Lista ordenada.
+ * @param indice Indice a insertar.
+ */
+void insertarIndiceOrdenado(vector<size_t> &indices, size_t indice) {
+    indices.insert(upper_bound(indices.begin(), indices.end(), indice), indice);
+}
+
+/**
+ * @brief Elimina un indice de una lista ordenada de indices de estudiantes.
+ * @param indices Lista ordenada.
+ * @param indice Indice a eliminar.
+ */
+void eliminarIndiceOrdenado(vector<size_t> &indices, size_t indice) {
+    const auto it = lower_bound(indices.begin(), indices.end(), indice);
+    if (it != indices.end() && *it == indice) {
+        indices.erase(it);
+    }
+}
+
+/**
+ * @brief Devuelve el hijo con la etiqueta indicada, creandolo en su posicion ordenada si falta.
+ * @param nodo Nodo padre.
+ * @param orden Secuencia de variables de clasificacion.
+ * @param etiqueta Etiqueta del hijo en el nivel nodo.nivel.
+ * @return Hijo existente o recien creado (sin estudiantes).
+ */
+NodoArbolClasificacion &obtenerHijo(NodoArbolClasificacion &nodo,
+                                    const vector<VariableClasificacion> &orden,
+                                    const string &etiqueta) {
+    auto posicion = posicionHijo(nodo, etiqueta);
+    if (posicion == nodo.hijos.end() || (*posicion)->etiqueta != etiqueta) {
+        auto hijo = make_unique<NodoArbolClasificacion>();
+        hijo->etiqueta = etiqueta;
+        hijo->variable = orden[nodo.nivel];
+        hijo->padre = &nodo;
+        hijo->nivel = nodo.nivel + 1;
+        CONTAR_NODOS(nodo.nivel + 1, 1U);
+        posicion = nodo.hijos.insert(posicion, move(hijo));
+    }
+    return **posicion;
+}
+
+/**
+ * @brief Agrega un estudiante al nodo indicado y a la rama que le corresponde por debajo de el,
+ *        creando los nodos que falten en su posicion ordenada.
+ * @param nodo Nodo desde el que se inserta.
+ * @param orden Secuencia de variables de clasificacion.
+ * @param etiquetas Etiquetas del estudiante por nivel (ver etiquetasClasificacion).
+ * @param indice Indice del estudiante.
+ */
+void insertarDesde(NodoArbolClasificacion &nodo, const vector<VariableClasificacion> &orden,
+                   const vector<string> &etiquetas, size_t indice) {
+    auto *actual = &nodo;
+    insertarIndiceOrdenado(actual->indicesEstudiantes, indice);
+    for (auto nivel = actual->nivel; nivel < etiquetas.size(); ++nivel) {
+        actual = &obtenerHijo(*actual, orden, etiquetas[nivel]);
+        insertarIndiceOrdenado(actual->indicesEstudiantes, indice);
+    }
+}
+
+/**
+ * @brief Retira un estudiante del nodo indicado y de su rama, eliminando los nodos que queden vacios.
+ * @param nodo Nodo desde el que se retira.
+ * @param etiquetas Etiquetas que tenia el estudiante por nivel.
+ * @param indice Indice del estudiante.
+ */
+void retirarDesde(NodoArbolClasificacion &nodo, const vector<string> &etiquetas, size_t indice) {
+    eliminarIndiceOrdenado(nodo.indicesEstudiantes, indice);
+    if (nodo.nivel >= etiquetas.size()) {
+        return;
+    }
+    const auto posicion = posicionHijo(nodo, etiquetas[nodo.nivel]);
+    if (posicion == nodo.hijos.end() || (*posicion)->etiqueta != etiquetas[nodo.nivel]) {
+        return;
+    }
+    retirarDesde(**posicion, etiquetas, indice);
+    if ((*posicion)->indicesEstudiantes.empty()) {
+        nodo.hijos.erase(posicion);
+    }
+}
+
+/**
+ * @brief Inserta un estudiante nuevo en un arbol ya construido.
+ * @param raiz Raiz del arbol.
+ * @param orden Secuencia de variables con la que se construyo el arbol.
+ * @param etiquetas Etiquetas del estudiante por nivel.
+ * @param indice Indice del estudiante; debe ser mayor que los ya presentes para un alta.
+ */
+void insertarEnArbol(NodoArbolClasificacion &raiz, const vector<VariableClasificacion> &orden,
+                     const vector<string> &etiquetas, size_t indice) {
+    insertarDesde(raiz, orden, etiquetas, indice);
+}
+
+/**
+ * @brief Mueve un estudiante cuyas etiquetas cambiaron a la rama que ahora le corresponde.
+ *
+ * Los nodos de los niveles con la misma etiqueta conservan al estudiante y no se modifican; solo
+ * se retira de la rama anterior y se inserta en la nueva desde el primer nivel distinto. Cada nodo
+ * tocado inserta o borra en su vector ordenado, asi que cuando solo cambia el ultimo nivel (el caso
+ * habitual, p. ej. el rango de promedio) el costo es el descenso mas dos hojas.
+ * @param raiz Raiz del arbol.
+ * @param orden Secuencia de variables con la que se construyo el arbol.
+ * @param anteriores Etiquetas del estudiante antes del cambio.
+ * @param nuevas Etiquetas del estudiante despues del cambio.
+ * @param indice Indice del estudiante.
+ */
+void reubicarEnArbol(NodoArbolClasificacion &raiz, const vector<VariableClasificacion> &orden,
+                     const vector<string> &anteriores, const vector<string> &nuevas, size_t indice) {
+    auto *nodo = &raiz;
+    size_t nivel = 0;
+    while (nivel < anteriores.size() && anteriores[nivel] == nuevas[nivel]) {
+        const auto posicion = posicionHijo(*nodo, anteriores[nivel]);
+        if (posicion == nodo->hijos.end() || (*posicion)->etiqueta != anteriores[nivel]) {
+            return;
+        }
+        nodo = posicion->get();
+        ++nivel;
+    }
+    if (nivel >= anteriores.size()) {
+        return;
+    }
+    if (const auto posicion = posicionHijo(*nodo, anteriores[nivel]);
+        posicion != nodo->hijos.end() && (*posicion)->etiqueta == anteriores[nivel]) {
+        retirarDesde(**posicion, anteriores, indice);
+        if ((*posicion)->indicesEstudiantes.empty()) {
+            nodo->hijos.erase(posicion);
+        }
+    }
+    insertarDesde(obtenerHijo(*nodo, orden, nuevas[nivel]), orden, nuevas, indice);
+}
+
+/**
+ * @brief Arena de memoria: entrega porciones de bloques grandes y libera todo en una sola operacion.
+ *
+ * Solo admite tipos trivialmente destructibles, porque nunca se ejecutan destructores individuales.
+ */
+class Arena {
+public:
+    explicit Arena(size_t tamanoBloque = size_t{1} << 20U) : tamanoBloque_(tamanoBloque) {}
+
+    /**
+     * @brief Reserva espacio contiguo y alineado para una cantidad de objetos.
+     * @param cantidad Numero de objetos.
+     * @return Puntero al primer objeto (sin inicializar).
+     */
+    template <typename T>
+    T *reservar(size_t cantidad) {
+        static_assert(is_trivially_destructible_v<T>, "La arena no ejecuta destructores.");
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "Alineacion no soportada.");
+        if (cantidad == 0) {
+            return nullptr;
+        }
+        const auto bytes = cantidad * sizeof(T);
+        auto desplazamiento = (usado_ + alignof(T) - 1) / alignof(T) * alignof(T);
+        if (bloques_.empty() || desplazamiento + bytes > capacidad_) {
+            capacidad_ = max(tamanoBloque_, bytes);
+            bloques_.emplace_back(new byte[capacidad_]);
+            desplazamiento = 0;
+        }
+        usado_ = desplazamiento + bytes;
+        bytesReservados_ += bytes;
+        return reinterpret_cast<T *>(bloques_.back().get() + desplazamiento);
+    }
+
+    /**
+     * @brief Devuelve todos los bloques al sistema.
+     */
+    void liberar() {
+        bloques_.clear();
+        usado_ = 0;
+        capacidad_ = 0;
+        bytesReservados_ = 0;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de bytes entregados desde la ultima liberacion.
+     * @return Bytes reservados.
+     */
+    [[nodiscard]] size_t bytesReservados() const {
+        return bytesReservados_;
+    }
+
+private:
+    size_t tamanoBloque_;
+    vector<unique_ptr<byte[]>> bloques_;
+    size_t usado_ = 0;
+    size_t capacidad_ = 0;
+    size_t bytesReservados_ = 0;
+};
+
+/**
+ * @brief Nodo del arbol plano; los hijos ocupan [primerHijo, primerHijo + cantidadHijos) y los
+ *        estudiantes el tramo [inicio, fin) de la permutacion compartida del arbol.
+ */
+struct NodoPlano {
+    uint32_t padre = 0;
+    uint32_t primerHijo = 0;
+    uint32_t cantidadHijos = 0;
+    uint32_t etiqueta = 0;
+    uint32_t nivel = 0;
+    uint32_t inicio = 0;
+    uint32_t fin = 0;
+};
+
+/**
+ * @brief Arbol de clasificacion inmutable con disposicion plana.
+ *
+ * Los nodos se guardan en anchura en un unico arreglo, de modo que cada nivel y los hijos de cada
+ * nodo son rangos contiguos; las etiquetas son identificadores de un diccionario propio. Todos los
+ * nodos referencian tramos de una sola permutacion de los indices de estudiantes: cada nivel se
+ * obtiene particionando de forma estable el tramo del padre, por lo que el arbol ocupa O(n) indices
+ * sin importar su profundidad. Nodos y permutacion se reservan en una arena que se libera de una
+ * vez al destruir el arbol.
+ */
+class ArbolPlano {
+public:
+    static constexpr uint32_t kSinPadre = numeric_limits<uint32_t>::max();
+
+    /**
+     * @brief Construye el arbol nivel por nivel particionando por los codigos de categoria.
+     * @param perfiles Perfiles de estudiantes que participan en el arbol.
+     * @param orden Secuencia de variables de clasificacion (niveles).
+     * @return Arbol construido; el nodo 0 es la raiz.
+     */
+    static ArbolPlano construir(const AlmacenPerfiles &perfiles,
+                                const vector<VariableClasificacion> &orden) {
+        ArbolPlano arbol;
+        arbol.orden_ = orden;
+        const auto total = static_cast<uint32_t>(perfiles.cantidad());
+        arbol.permutacion_ = arbol.arena_.reservar<uint32_t>(total);
+        iota(arbol.permutacion_, arbol.permutacion_ + total, 0U);
+
+        vector<NodoPlano> nodos;
+        auto &raiz = nodos.emplace_back();
+        raiz.padre = kSinPadre;
+        raiz.etiqueta = arbol.etiquetas_.registrar("Poblacion total");
+        raiz.fin = total;
+        CONTAR_NODOS(0U, 1U);
+        arbol.inicioNiveles_.push_back(0U);
+        arbol.particionarNiveles(perfiles, nodos, 0);
+        return arbol;
+    }
+
+    /**
+     * @brief Construye un arbol reutilizando los niveles que comparte con otro ya construido.
+     *
+     * Copia los nodos y la permutacion de los niveles comunes, devuelve cada tramo del ultimo nivel
+     * comun a orden ascendente (el estado que tenia antes de los niveles siguientes) y solo
+     * particiona los niveles restantes. El resultado es identico al de construir.
+     * @param base Arbol construido con los mismos perfiles.
+     * @param perfiles Perfiles de estudiantes que participan en el arbol.
+     * @param orden Secuencia de variables del arbol nuevo.
+     * @return Arbol construido.
+     */
+    static ArbolPlano extender(const ArbolPlano &base, const AlmacenPerfiles &perfiles,
+                               const vector<VariableClasificacion> &orden) {
+        const auto comunes = nivelesComunes(base.orden_, orden);
+        ArbolPlano arbol;
+        arbol.orden_ = orden;
+        const auto total = base.nodos_[0].fin;
+        arbol.permutacion_ = arbol.arena_.reservar<uint32_t>(total);
+        copy(base.permutacion_, base.permutacion_ + total, arbol.permutacion_);
+        for (uint32_t id = 0; id < base.etiquetas_.tamano(); ++id) {
+            arbol.etiquetas_.registrar(base.etiquetas_.valor(id));
+        }
+
+        vector<NodoPlano> nodos(base.nodos_, base.nodos_ + base.inicioNiveles_[comunes + 1]);
+        arbol.inicioNiveles_.assign(base.inicioNiveles_.begin(),
+                                    base.inicioNiveles_.begin() + static_cast<ptrdiff_t>(comunes) + 1);
+        for (size_t nivel = 0; nivel <= comunes; ++nivel) {
+            CONTAR_NODOS(nivel, base.inicioNiveles_[nivel + 1] - base.inicioNiveles_[nivel]);
+        }
+        for (auto id = arbol.inicioNiveles_.back(); id < nodos.size(); ++id) {
+            nodos[id].primerHijo = 0;
+            nodos[id].cantidadHijos = 0;
+            if (comunes < base.orden_.size()) {
+                sort(arbol.permutacion_ + nodos[id].inicio, arbol.permutacion_ + nodos[id].fin);
+            }
+        }
+        arbol.particionarNiveles(perfiles, nodos, comunes);
+        return arbol;
+    }
+
+    /**
+     * @brief Cuenta cuantas variables iniciales comparten dos ordenes de clasificacion.
+     * @param primero Primer orden.
+     * @param segundo Segundo orden.
+     * @return Longitud del prefijo comun.
+     */
+    static size_t nivelesComunes(const vector<VariableClasificacion> &primero,
+                                 const vector<VariableClasificacion> &segundo) {
+        const auto limite = min(primero.size(), segundo.size());
+        size_t comunes = 0;
+        while (comunes < limite && primero[comunes] == segundo[comunes]) {
+            ++comunes;
+        }
+        return comunes;
+    }
+
+    /**
+     * @brief Devuelve la cantidad total de nodos.
+     * @return Numero de nodos.
+     */
+    [[nodiscard]] uint32_t cantidadNodos() const {
+        return cantidadNodos_;
+    }
+
+    /**
+     * @brief Devuelve un nodo por su posicion en el arreglo.
+     * @param id Posicion del nodo (0 es la raiz).
+     * @return Referencia constante al nodo.
+     */
+    [[nodiscard]] const NodoPlano &nodo(uint32_t id) const {
+        return nodos_[id];
+    }
+
+    /**
+     * @brief Devuelve el texto de la etiqueta de un nodo.
+     * @param id Posicion del nodo.
+     * @return Etiqueta del nodo.
+     */
+    [[nodiscard]] const string &etiqueta(uint32_t id) const {
+        return etiquetas_.valor(nodos_[id].etiqueta);
+    }
+
+    /**
+     * @brief Devuelve la variable que clasifica al nodo, o nullopt para la raiz.
+     * @param id Posicion del nodo.
+     * @return Variable del nivel del nodo.
+     */
+    [[nodiscard]] optional<VariableClasificacion> variable(uint32_t id) const {
+        const auto nivel = nodos_[id].nivel;
+        if (nivel == 0) {
+            return nullopt;
+        }
+        return orden_[nivel - 1];
+    }
+
+    /**
+     * @brief Devuelve los indices de los estudiantes del nodo.
+     *
+     * En las hojas conservan el orden ascendente; en los nodos internos aparecen agrupados por hijo.
+     * @param id Posicion del nodo.
+     * @return Vista sobre el tramo de la permutacion, sin copiarlo.
+     */
+    [[nodiscard]] span<const uint32_t> indices(uint32_t id) const {
+        return {permutacion_ + nodos_[id].inicio, nodos_[id].fin - nodos_[id].inicio};
+    }
+
+    /**
+     * @brief Devuelve el orden de variables con el que se construyo el arbol.
+     * @return Secuencia de variables.
+     */
+    [[nodiscard]] const vector<VariableClasificacion> &orden() const {
+        return orden_;
+    }
+
+    /**
+     * @brief Devuelve los bytes ocupados por nodos y permutacion dentro de la arena.
+     * @return Bytes reservados.
+     */
+    [[nodiscard]] size_t bytesReservados() const {
+        return arena_.bytesReservados();
+    }
+
+private:
+    /**
+     * @brief Crea los niveles desde nivelInicial hasta el final del orden y fija los nodos en la arena.
+     * @param perfiles Perfiles de estudiantes que participan en el arbol.
+     * @param nodos Nodos ya creados; los del ultimo nivel aun no tienen hijos.
+     * @param nivelInicial Nivel cuyos nodos se particionan primero.
+     */
+    void particionarNiveles(const AlmacenPerfiles &perfiles, vector<NodoPlano> &nodos,
+                            size_t nivelInicial) {
+        vector<uint32_t> auxiliar(nodos.front().fin);
+        vector<uint32_t> conteos;
+        vector<uint32_t> siguiente;
+        for (size_t nivel = nivelInicial; nivel < orden_.size(); ++nivel) {
+            const auto variable = orden_[nivel];
+            const auto &codigos = perfiles.codigos(variable);
+            const auto inicioNivel = inicioNiveles_.back();
+            const auto finNivel = static_cast<uint32_t>(nodos.size());
+            inicioNiveles_.push_back(finNivel);
+            for (auto id = inicioNivel; id < finNivel; ++id) {
+                MEDIR_NIVEL(nivel);
+                auto *tramo = permutacion_ + nodos[id].inicio;
+                const auto cantidad = nodos[id].fin - nodos[id].inicio;
+                conteos.assign(perfiles.cantidadCategorias(variable), 0U);
+                siguiente.assign(conteos.size(), 0U);
+                for (uint32_t k = 0; k < cantidad; ++k) {
+                    ++conteos[codigos[tramo[k]]];
+                }
+                nodos[id].primerHijo = static_cast<uint32_t>(nodos.size());
+                auto desplazamiento = nodos[id].inicio;
+                for (const auto codigo : perfiles.codigosEnOrden(variable)) {
+                    if (conteos[codigo] == 0) {
+                        continue;
+                    }
+                    auto &hijo = nodos.emplace_back();
+                    hijo.padre = id;
+                    hijo.etiqueta = etiquetas_.registrar(perfiles.etiqueta(variable, codigo));
+                    hijo.nivel = static_cast<uint32_t>(nivel + 1);
+                    hijo.inicio = desplazamiento;
+                    hijo.fin = desplazamiento + conteos[codigo];
+                    siguiente[codigo] = desplazamiento - nodos[id].inicio;
+                    desplazamiento = hijo.fin;
+                    ++nodos[id].cantidadHijos;
+                }
+                // Particion estable del tramo del padre: cada hijo queda contiguo y en orden.
+                for (uint32_t k = 0; k < cantidad; ++k) {
+                    auxiliar[siguiente[codigos[tramo[k]]]++] = tramo[k];
+                }
+                copy(auxiliar.begin(), auxiliar.begin() + cantidad, tramo);
+            }
+            CONTAR_NODOS(nivel + 1, nodos.size() - finNivel);
+        }
+        inicioNiveles_.push_back(static_cast<uint32_t>(nodos.size()));
+
+        cantidadNodos_ = static_cast<uint32_t>(nodos.size());
+        nodos_ = arena_.reservar<NodoPlano>(nodos.size());
+        copy(nodos.begin(), nodos.end(), nodos_);
+    }
+
+    Arena arena_;
+    NodoPlano *nodos_ = nullptr;
+    uint32_t cantidadNodos_ = 0;
+    uint32_t *permutacion_ = nullptr;
+    DiccionarioCadenas etiquetas_;
+    vector<VariableClasificacion> orden_;
+    vector<uint32_t> inicioNiveles_;
+};
+
+/**
+ * @brief Cache LRU acotada de arboles planos indexada por el orden de clasificacion.
+ *
+ * Un orden ya construido se devuelve directamente; uno nuevo se construye a partir del arbol en
+ * cache que comparta el prefijo de variables mas largo. Debe invalidarse cuando cambian los perfiles.
+ */
+class CacheArboles {
+public:
+    explicit CacheArboles(size_t capacidad = kCapacidadCacheArboles)
+        : capacidad_(max<size_t>(1U, capacidad)) {}
+
+    /**
+     * @brief Devuelve el arbol para un orden, construyendolo o extendiendolo si hace falta.
+     * @param perfiles Perfiles vigentes.
+     * @param orden Secuencia de variables de clasificacion.
+     * @return Arbol compartido con la cache.
+     */
+    shared_ptr<const ArbolPlano> obtener(const AlmacenPerfiles &perfiles,
+                                         const vector<VariableClasificacion> &orden) {
+        auto mejor = entradas_.end();
+        size_t mejoresComunes = 0;
+        for (auto it = entradas_.begin(); it != entradas_.end(); ++it) {
+            if (it->orden == orden) {
+                entradas_.splice(entradas_.begin(), entradas_, it);
+                return entradas_.front().arbol;
+            }
+            const auto comunes = ArbolPlano::nivelesComunes(it->orden, orden);
+            if (comunes > mejoresComunes) {
+                mejor = it;
+                mejoresComunes = comunes;
+            }
+        }
+
+        auto arbol = make_shared<const ArbolPlano>(
+            mejor == entradas_.end() ? ArbolPlano::construir(perfiles, orden)
+                                     : ArbolPlano::extender(*mejor->arbol, perfiles, orden));
+        entradas_.push_front({orden, arbol});
+        if (entradas_.size() > capacidad_) {
+            entradas_.pop_back();
+        }
+        return arbol;
+    }
+
+    /**
+     * @brief Descarta todos los arboles almacenados.
+     */
+    void invalidar() {
+        entradas_.clear();
+    }
+
+private:
+    struct Entrada {
+        vector<VariableClasificacion> orden;
+        shared_ptr<const ArbolPlano> arbol;
+    };
+
+    size_t capacidad_;
+    list<Entrada> entradas_;
+};
+
+/**
+ * @brief Cubo de conteos sobre un subconjunto de variables de clasificacion.
+ *
+ * Cada dimension tiene una posicion por codigo de categoria mas una posicion final de total, de modo
+ * que cualquier combinacion de variables fijas y libres es una sola celda. Asi los conteos de los
+ * nodos de cualquier arbol cuyo orden use solo dimensiones del cubo se leen sin recorrer estudiantes.
+ */
+class CuboConteos {
+public:
+    /**
+     * @brief Elige las dimensiones del cubo descartando las de mas categorias hasta respetar el limite.
+     * @param perfiles Perfiles vigentes.
+     * @param requeridas Variables que no pueden descartarse.
+     * @param maximoCeldas Cantidad maxima de celdas.
+     * @return Dimensiones en el orden de VariableClasificacion, o nullopt si las requeridas no caben.
+     */
+    static optional<vector<VariableClasificacion>>
+    elegirDimensiones(const AlmacenPerfiles &perfiles, const vector<VariableClasificacion> &requeridas,
+                      size_t maximoCeldas = kMaximoCeldasCubo) {
+        vector<VariableClasificacion> dimensiones;
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            dimensiones.push_back(static_cast<VariableClasificacion>(variable));
+        }
+        const auto extension = [&perfiles](VariableClasificacion variable) {
+            return perfiles.cantidadCategorias(variable) + 1;
+        };
+        while (!cabe(dimensiones, extension, maximoCeldas)) {
+            auto descartable = dimensiones.end();
+            for (auto it = dimensiones.begin(); it != dimensiones.end(); ++it) {
+                if (find(requeridas.begin(), requeridas.end(), *it) == requeridas.end() &&
+                    (descartable == dimensiones.end() || extension(*it) > extension(*descartable))) {
+                    descartable = it;
+                }
+            }
+            if (descartable == dimensiones.end()) {
+                return nullopt;
+            }
+            dimensiones.erase(descartable);
+        }
+        return dimensiones;
+    }
+
+    /**
+     * @brief Construye el cubo con un histograma paralelo y luego acumula los totales por dimension.
+     * @param perfiles Perfiles vigentes.
+     * @param dimensiones Variables del cubo; deben caber en kMaximoCeldasCubo.
+     * @param pool Pool de hilos que reparte el trabajo.
+     * @return Cubo construido.
+     */
+    static CuboConteos construir(const AlmacenPerfiles &perfiles,
+                                 const vector<VariableClasificacion> &dimensiones, PoolTrabajo &pool) {
+        CuboConteos cubo;
+        size_t celdas = 1;
+        vector<const uint16_t *> columnas;
+        for (const auto variable : dimensiones) {
+            auto &dimension = cubo.dimensiones_.emplace_back();
+            dimension.variable = variable;
+            dimension.categorias = static_cast<uint16_t>(perfiles.cantidadCategorias(variable));
+            dimension.paso = celdas;
+            dimension.enOrden = perfiles.codigosEnOrden(variable);
+            for (uint16_t codigo = 0; codigo < dimension.categorias; ++codigo) {
+                dimension.etiquetas.push_back(perfiles.etiqueta(variable, codigo));
+            }
+            celdas *= dimension.categorias + 1U;
+            columnas.push_back(perfiles.codigos(variable).data());
+        }
+
+        const auto total = perfiles.cantidad();
+        const auto paralelo = total >= kUmbralConstruccionParalela && pool.hilos() > 1;
+        const auto bloques =
+            paralelo ? max<size_t>(1U, min(pool.hilos(), kMaximoCeldasParcialesCubo / celdas)) : 1U;
+        vector<vector<uint32_t>> parciales(bloques);
+        const auto contar = [&](size_t bloque) {
+            auto &parcial = parciales[bloque];
+            parcial.assign(celdas, 0U);
+            const auto fin = total * (bloque + 1) / bloques;
+            for (auto indice = total * bloque / bloques; indice < fin; ++indice) {
+                size_t celda = 0;
+                for (size_t d = 0; d < columnas.size(); ++d) {
+                    celda += columnas[d][indice] * cubo.dimensiones_[d].paso;
+                }
+                ++parcial[celda];
+            }
+        };
+        repartirRango(pool, paralelo, bloques, [&](size_t inicio, size_t fin) {
+            for (auto bloque = inicio; bloque < fin; ++bloque) {
+                contar(bloque);
+            }
+        });
+
+        cubo.conteos_ = move(parciales.front());
+        repartirRango(pool, paralelo && bloques > 1, celdas, [&](size_t inicio, size_t fin) {
+            for (size_t bloque = 1; bloque < bloques; ++bloque) {
+                for (auto celda = inicio; celda < fin; ++celda) {
+                    cubo.conteos_[celda] += parciales[bloque][celda];
+                }
+            }
+        });
+
+        // Cada pasada llena la posicion de total de una dimension sumando sus categorias; como las
+        // pasadas previas ya llenaron los totales de otras dimensiones, al final existen todas las
+        // combinaciones de variables fijas y libres.
+        for (const auto &dimension : cubo.dimensiones_) {
+            const auto bloque = dimension.paso * (dimension.categorias + 1U);
+            const auto filas = celdas / bloque * dimension.paso;
+            repartirRango(pool, paralelo, filas, [&](size_t inicio, size_t fin) {
+                for (auto fila = inicio; fila < fin; ++fila) {
+                    const auto base = fila / dimension.paso * bloque + fila % dimension.paso;
+                    uint32_t suma = 0;
+                    for (uint16_t codigo = 0; codigo < dimension.categorias; ++codigo) {
+                        suma += cubo.conteos_[base + codigo * dimension.paso];
+                    }
+                    cubo.conteos_[base + dimension.categorias * dimension.paso] = suma;
+                }
+            });
+        }
+        return cubo;
+    }
+
+    /**
+     * @brief Indica si todas las variables de un orden son dimensiones del cubo.
+     * @param orden Secuencia de variables de clasificacion.
+     * @return true cuando el cubo puede responder por ese orden.
+     */
+    [[nodiscard]] bool cubre(const vector<VariableClasificacion> &orden) const {
+        if (conteos_.empty()) {
+            return false;
+        }
+        return all_of(orden.begin(), orden.end(), [this](VariableClasificacion variable) {
+            return dimension(variable).has_value();
+        });
+    }
+
+    /**
+     * @brief Devuelve la posicion de una variable entre las dimensiones del cubo.
+     * @param variable Variable de clasificacion.
+     * @return Posicion de la dimension, o nullopt si el cubo no la incluye.
+     */
+    [[nodiscard]] optional<size_t> dimension(VariableClasificacion variable) const {
+        for (size_t d = 0; d < dimensiones_.size(); ++d) {
+            if (dimensiones_[d].variable == variable) {
+                return d;
+            }
+        }
+        return nullopt;
+    }
+
+    /**
+     * @brief Suma o resta un estudiante en todas las celdas que lo contienen.
+     * @param perfiles Perfiles vigentes.
+     * @param indice Indice del estudiante.
+     * @param delta 1 para agregarlo, -1 para retirarlo.
+     * @return false si el estudiante tiene una categoria nueva; el cubo debe reconstruirse.
+     */
+    bool ajustar(const AlmacenPerfiles &perfiles, size_t indice, int delta) {
+        if (conteos_.empty()) {
+            return false;
+        }
+        vector<size_t> celdaCodigo;
+        for (const auto &dimension : dimensiones_) {
+            const auto codigo = perfiles.codigo(dimension.variable, indice);
+            if (codigo >= dimension.categorias) {
+                return false;
+            }
+            celdaCodigo.push_back(codigo * dimension.paso);
+        }
+        for (size_t mascara = 0; mascara < (size_t{1} << dimensiones_.size()); ++mascara) {
+            size_t celda = 0;
+            for (size_t d = 0; d < dimensiones_.size(); ++d) {
+                celda += (mascara >> d & 1U) != 0U
+                             ? dimensiones_[d].categorias * dimensiones_[d].paso
+                             : celdaCodigo[d];
+            }
+            conteos_[celda] += static_cast<uint32_t>(delta);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Devuelve la celda con todas las dimensiones libres (la poblacion total).
+     */
+    [[nodiscard]] size_t celdaTotal() const {
+        return conteos_.empty() ? 0U : conteos_.size() - 1;
+    }
+
+    /**
+     * @brief Devuelve el conteo de una celda.
+     * @param celda Celda consultada.
+     */
+    [[nodiscard]] size_t conteo(size_t celda) const {
+        return conteos_[celda];
+    }
+
+    /**
+     * @brief Devuelve la variable de una dimension.
+     * @param d Posicion de la dimension.
+     */
+    [[nodiscard]] VariableClasificacion variable(size_t d) const {
+        return dimensiones_[d].variable;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de categorias de una dimension.
+     * @param d Posicion de la dimension.
+     */
+    [[nodiscard]] uint16_t categorias(size_t d) const {
+        return dimensiones_[d].categorias;
+    }
+
+    /**
+     * @brief Devuelve la distancia entre celdas consecutivas de una dimension.
+     * @param d Posicion de la dimension.
+     */
+    [[nodiscard]] size_t paso(size_t d) const {
+        return dimensiones_[d].paso;
+    }
+
+    /**
+     * @brief Devuelve los codigos de una dimension ordenados por etiqueta.
+     * @param d Posicion de la dimension.
+     */
+    [[nodiscard]] const vector<uint16_t> &codigosEnOrden(size_t d) const {
+        return dimensiones_[d].enOrden;
+    }
+
+    /**
+     * @brief Devuelve la etiqueta de un codigo de una dimension.
+     * @param d Posicion de la dimension.
+     * @param codigo Codigo de categoria.
+     */
+    [[nodiscard]] const string &etiqueta(size_t d, uint16_t codigo) const {
+        return dimensiones_[d].etiquetas[codigo];
+    }
+
+    /**
+     * @brief Devuelve la cantidad de celdas del cubo.
+     */
+    [[nodiscard]] size_t cantidadCeldas() const {
+        return conteos_.size();
+    }
+
+private:
+    struct DimensionCubo {
+        VariableClasificacion variable = VariableClasificacion::Genero;
+        uint16_t categorias = 0;
+        size_t paso = 1;
+        vector<uint16_t> enOrden;
+        vector<string> etiquetas;
+    };
+
+    /**
+     * @brief Indica si el producto de las extensiones de las dimensiones no supera el limite.
+     */
+    template <typename Extension>
+    static bool cabe(const vector<VariableClasificacion> &dimensiones, Extension &&extension,
+                     size_t maximoCeldas) {
+        size_t celdas = 1;
+        for (const auto variable : dimensiones) {
+            if (celdas > maximoCeldas / extension(variable)) {
+                return false;
+            }
+            celdas *= extension(variable);
+        }
+        return true;
+    }
+
+    vector<DimensionCubo> dimensiones_;
+    vector<uint32_t> conteos_;
+};
+
+/**
+ * @brief Condicion "variable = categoria" expresada con el codigo de la categoria.
+ */
+struct CondicionClasificacion {
+    VariableClasificacion variable = VariableClasificacion::Genero;
+    uint16_t codigo = 0;
+};
+
+/**
+ * @brief Indice por categoria de cada variable: bitmaps para las de pocas categorias y listas de
+ *        indices para las de muchas.
+ *
+ * El bit i del bitmap de (variable, codigo) vale 1 si el estudiante i tiene esa categoria. Contar los
+ * estudiantes que cumplen varias condiciones es un AND de bitmaps seguido de popcount, procesado por
+ * bloques que caben en cache; en CPUs con AVX2 y POPCNT el AND usa registros de 256 bits y el conteo
+ * la instruccion popcnt, y en las demas se usa el ciclo portable. Una variable con mas de
+ * kMaxCategoriasDensas categorias (ColegioProcedencia, por ejemplo) usaria un bitmap casi vacio de
+ * n/8 bytes por categoria; en su lugar guarda la lista ordenada de estudiantes de cada categoria,
+ * que en total ocupa un entero por estudiante. Si alguna condicion es de una variable dispersa, el
+ * conteo recorre su lista mas corta y comprueba las demas condiciones en la copia de los codigos.
+ */
+class IndiceBitmap {
+public:
+    /**
+     * @brief Construye el indice repartiendo por tramos de palabras cada variable densa en el pool.
+     * @param perfiles Perfiles vigentes.
+     * @param pool Pool de hilos que reparte el trabajo.
+     * @return Indice construido.
+     */
+    static IndiceBitmap construir(const AlmacenPerfiles &perfiles, PoolTrabajo &pool) {
+        IndiceBitmap indice;
+        indice.cantidad_ = perfiles.cantidad();
+        indice.palabras_ = (indice.cantidad_ + kBitsPorPalabra - 1) / kBitsPorPalabra;
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            indice.codigos_[variable] = perfiles.codigos(static_cast<VariableClasificacion>(variable));
+        }
+        indice.asegurarCategorias(perfiles);
+        const auto paralelo = indice.cantidad_ >= kUmbralConstruccionParalela && pool.hilos() > 1;
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            if (indice.dispersa_[variable]) {
+                for (size_t codigo = 0; codigo < indice.listas_[variable].size(); ++codigo) {
+                    indice.cardinalidades_[variable][codigo] = indice.listas_[variable][codigo].size();
+                }
+                continue;
+            }
+            const auto &codigos = indice.codigos_[variable];
+            auto &bitsets = indice.bitsets_[variable];
+            // Cada tramo escribe palabras distintas, por eso no hace falta sincronizar.
+            repartirRango(pool, paralelo, indice.palabras_, [&](size_t inicio, size_t fin) {
+                const auto ultimo = min(indice.cantidad_, fin * kBitsPorPalabra);
+                for (auto i = inicio * kBitsPorPalabra; i < ultimo; ++i) {
+                    bitsets[codigos[i]][i / kBitsPorPalabra] |= uint64_t{1} << (i % kBitsPorPalabra);
+                }
+            });
+            for (size_t codigo = 0; codigo < bitsets.size(); ++codigo) {
+                const uint64_t *bitset = bitsets[codigo].data();
+                indice.cardinalidades_[variable][codigo] =
+                    contarInterseccion(span(&bitset, 1), 1U, indice.palabras_).second;
+            }
+        }
+        return indice;
+    }
+
+    /**
+     * @brief Incorpora al indice el estudiante agregado al final del almacen.
+     * @param perfiles Perfiles vigentes.
+     * @param indice Indice del nuevo estudiante; debe ser igual a la cantidad indexada.
+     */
+    void agregarEstudiante(const AlmacenPerfiles &perfiles, size_t indice) {
+        cantidad_ = indice + 1;
+        if (cantidad_ > palabras_ * kBitsPorPalabra) {
+            ++palabras_;
+            for (auto &bitsets : bitsets_) {
+                for (auto &bitset : bitsets) {
+                    bitset.push_back(0U);
+                }
+            }
+        }
+        asegurarCategorias(perfiles);
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            const auto codigo = perfiles.codigo(static_cast<VariableClasificacion>(variable), indice);
+            codigos_[variable].push_back(codigo);
+            marcar(variable, codigo, indice, true);
+        }
+    }
+
+    /**
+     * @brief Vuelve a ubicar a un estudiante cuyas categorias pudieron cambiar.
+     *
+     * Por cada variable solo se tocan la categoria anterior, tomada de la copia de los codigos, y la
+     * nueva.
+     * @param perfiles Perfiles vigentes.
+     * @param indice Indice del estudiante.
+     */
+    void actualizarEstudiante(const AlmacenPerfiles &perfiles, size_t indice) {
+        asegurarCategorias(perfiles);
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            const auto actual = perfiles.codigo(static_cast<VariableClasificacion>(variable), indice);
+            auto &anterior = codigos_[variable][indice];
+            if (anterior != actual) {
+                marcar(variable, anterior, indice, false);
+                marcar(variable, actual, indice, true);
+                anterior = actual;
+            }
+        }
+    }
+
+    /**
+     * @brief Cuenta los estudiantes que cumplen todas las condiciones.
+     * @param condiciones Condiciones combinadas con AND; vacia equivale a todos los estudiantes.
+     * @return Cantidad de estudiantes.
+     */
+    [[nodiscard]] size_t contar(span<const CondicionClasificacion> condiciones) const {
+        if (condiciones.empty()) {
+            return cantidad_;
+        }
+        for (const auto &condicion : condiciones) {
+            if (condicion.codigo >= cardinalidades_[static_cast<size_t>(condicion.variable)].size()) {
+                return 0;
+            }
+        }
+        if (const auto *lista = listaMasCorta(condiciones); lista != nullptr) {
+            return static_cast<size_t>(count_if(lista->begin(), lista->end(), [&](uint32_t i) {
+                return cumple(condiciones, i);
+            }));
+        }
+        vector<const uint64_t *> bitsets;
+        bitsets.reserve(condiciones.size());
+        for (const auto &condicion : condiciones) {
+            const auto &categorias = bitsets_[static_cast<size_t>(condicion.variable)];
+            bitsets.push_back(categorias[condicion.codigo].data());
+        }
+        return contarInterseccion(bitsets, bitsets.size(), palabras_).second;
+    }
+
+    /**
+     * @brief Cuenta en una sola pasada los estudiantes que cumplen la evidencia y los que ademas
+     * cumplen el objetivo.
+     *
+     * Las condiciones se intersectan en el orden recibido y cada bloque se abandona en cuanto su
+     * interseccion queda vacia, por lo que conviene pasar primero las mas selectivas. Si hay
+     * condiciones de variables dispersas se recorre la lista mas corta en lugar de los bitmaps.
+     * @param evidencia Condiciones dadas; vacia equivale a todos los estudiantes.
+     * @param objetivo Condiciones cuya probabilidad se calcula; no puede estar vacia.
+     * @return Par (casos que cumplen la evidencia, casos que cumplen evidencia y objetivo).
+     */
+    [[nodiscard]] pair<size_t, size_t>
+    contarCondicionado(span<const CondicionClasificacion> evidencia,
+                       span<const CondicionClasificacion> objetivo) const {
+        if (const auto *lista = listaMasCorta(evidencia); lista != nullptr) {
+            size_t casos = 0;
+            size_t favorables = 0;
+            for (const auto i : *lista) {
+                if (cumple(evidencia, i)) {
+                    ++casos;
+                    favorables += cumple(objetivo, i) ? 1U : 0U;
+                }
+            }
+            return {casos, favorables};
+        }
+        if (listaMasCorta(objetivo) != nullptr) {
+            vector<CondicionClasificacion> todas(evidencia.begin(), evidencia.end());
+            todas.insert(todas.end(), objetivo.begin(), objetivo.end());
+            return {contar(evidencia), contar(todas)};
+        }
+        vector<const uint64_t *> bitsets;
+        for (const auto condiciones : {evidencia, objetivo}) {
+            for (const auto &condicion : condiciones) {
+                const auto &categorias = bitsets_[static_cast<size_t>(condicion.variable)];
+                bitsets.push_back(categorias[condicion.codigo].data());
+            }
+        }
+        const auto [casos, favorables] = contarInterseccion(bitsets, evidencia.size(), palabras_);
+        return {evidencia.empty() ? cantidad_ : casos, favorables};
+    }
+
+    /**
+     * @brief Devuelve cuantos estudiantes tienen una categoria.
+     * @param condicion Variable y codigo de la categoria.
+     */
+    [[nodiscard]] size_t cardinalidad(const CondicionClasificacion &condicion) const {
+        const auto &cardinalidades = cardinalidades_[static_cast<size_t>(condicion.variable)];
+        return condicion.codigo < cardinalidades.size() ? cardinalidades[condicion.codigo] : 0U;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes indexados.
+     */
+    [[nodiscard]] size_t cantidad() const {
+        return cantidad_;
+    }
+
+private:
+    static constexpr size_t kBitsPorPalabra = 64;
+    static constexpr size_t kPalabrasPorBloque = 512;
+    // Con mas categorias, los bitmaps de una variable ocuparian mas que un entero por estudiante.
+    static constexpr size_t kMaxCategoriasDensas = 32;
+
+    /**
+     * @brief Agrega contenedores vacios para las categorias registradas despues de construir el
+     *        indice; una variable densa que supera kMaxCategoriasDensas pasa a listas.
+     * @param perfiles Perfiles vigentes.
+     */
+    void asegurarCategorias(const AlmacenPerfiles &perfiles) {
+        for (size_t variable = 0; variable < kCantidadVariables; ++variable) {
+            const auto categorias =
+                perfiles.cantidadCategorias(static_cast<VariableClasificacion>(variable));
+            cardinalidades_[variable].resize(categorias, 0U);
+            if (!dispersa_[variable] && categorias > kMaxCategoriasDensas) {
+                dispersa_[variable] = true;
+                bitsets_[variable].clear();
+                bitsets_[variable].shrink_to_fit();
+                // codigos_ refleja lo que ya estaba indexado, por eso las listas quedan coherentes.
+                listas_[variable].assign(categorias, {});
+                for (size_t i = 0; i < codigos_[variable].size(); ++i) {
+                    listas_[variable][codigos_[variable][i]].push_back(static_cast<uint32_t>(i));
+                }
+            }
+            if (dispersa_[variable]) {
+                listas_[variable].resize(categorias);
+            } else {
+                bitsets_[variable].resize(categorias, vector<uint64_t>(palabras_, 0U));
+            }
+        }
+    }
+
+    /**
+     * @brief Pone o quita a un estudiante en el contenedor de una categoria.
+     * @param variable Posicion de la variable.
+     * @param codigo Codigo de la categoria.
+     * @param indice Indice del estudiante.
+     * @param presente true para ponerlo, false para quitarlo.
+     */
+    void marcar(size_t variable, uint16_t codigo, size_t indice, bool presente) {
+        if (dispersa_[variable]) {
+            auto &lista = listas_[variable][codigo];
+            const auto posicion = lower_bound(lista.begin(), lista.end(), indice);
+            if ((posicion != lista.end() && *posicion == indice) == presente) {
+                return;
+            }
+            if (presente) {
+                lista.insert(posicion, static_cast<uint32_t>(indice));
+            } else {
+                lista.erase(posicion);
+            }
+        } else {
+            auto &palabra = bitsets_[variable][codigo][indice / kBitsPorPalabra];
+            const auto bit = uint64_t{1} << (indice % kBitsPorPalabra);
+            if ((palabra & bit) == (presente ? bit : 0U)) {
+                return;
+            }
+            palabra ^= bit;
+        }
+        cardinalidades_[variable][codigo] += presente ? 1U : static_cast<size_t>(-1);
+    }
+
+    /**
+     * @brief Devuelve la lista mas corta entre las condiciones de variables dispersas.
+     * @param condiciones Condiciones con codigos validos.
+     * @return Lista de estudiantes, o nullptr si todas las condiciones son de variables densas.
+     */
+    [[nodiscard]] const vector<uint32_t> *
+    listaMasCorta(span<const CondicionClasificacion> condiciones) const {
+        const vector<uint32_t> *resultado = nullptr;
+        for (const auto &condicion : condiciones) {
+            const auto variable = static_cast<size_t>(condicion.variable);
+            if (!dispersa_[variable]) {
+                continue;
+            }
+            const auto &lista = listas_[variable][condicion.codigo];
+            if (resultado == nullptr || lista.size() < resultado->size()) {
+                resultado = &lista;
+            }
+        }
+        return resultado;
+    }
+
+    /**
+     * @brief Indica si un estudiante cumple todas las condiciones segun la copia de los codigos.
+     * @param condiciones Condiciones combinadas con AND.
+     * @param indice Indice del estudiante.
+     */
+    [[nodiscard]] bool cumple(span<const CondicionClasificacion> condiciones, size_t indice) const {
+        return all_of(condiciones.begin(), condiciones.end(), [&](const auto &condicion) {
+            return codigos_[static_cast<size_t>(condicion.variable)][indice] == condicion.codigo;
+        });
+    }
+
+    /**
+     * @brief Cuenta los bits en 1 del AND de los primeros bitmaps y del AND de todos.
+     *
+     * Cada bloque se abandona en cuanto su interseccion queda vacia. Usa la ruta AVX2/POPCNT si la
+     * CPU la admite.
+     * @param bitsets Bitmaps del mismo tamano a intersectar en orden; no puede estar vacio.
+     * @param corte Cantidad de bitmaps del primer conteo (0 si no interesa).
+     * @param palabras Palabras de 64 bits de cada bitmap.
+     * @return Par (bits del AND de los primeros corte bitmaps, bits del AND de todos).
+     */
+    static pair<size_t, size_t> contarInterseccion(span<const uint64_t *const> bitsets, size_t corte,
+                                                   size_t palabras) {
+#if PROYECTO_AVX2
+        static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+        if (avx2) {
+            return contarInterseccionAvx2(bitsets, corte, palabras);
+        }
+#endif
+        array<uint64_t, kPalabrasPorBloque> bloque{};
+        size_t parcial = 0;
+        size_t total = 0;
+        for (size_t inicio = 0; inicio < palabras; inicio += kPalabrasPorBloque) {
+            const auto cantidad = min(kPalabrasPorBloque, palabras - inicio);
+            copy(bitsets[0] + inicio, bitsets[0] + inicio + cantidad, bloque.begin());
+            for (size_t k = 0; k < bitsets.size(); ++k) {
+                if (k > 0) {
+                    uint64_t restantes = 0;
+                    const auto *palabrasBitset = bitsets[k] + inicio;
+                    for (size_t j = 0; j < cantidad; ++j) {
+                        bloque[j] &= palabrasBitset[j];
+                        restantes |= bloque[j];
+                    }
+                    if (restantes == 0U) {
+                        break;
+                    }
+                }
+                if (k + 1 == corte || k + 1 == bitsets.size()) {
+                    size_t unos = 0;
+                    for (size_t j = 0; j < cantidad; ++j) {
+                        unos += static_cast<size_t>(popcount(bloque[j]));
+                    }
+                    parcial += k + 1 == corte ? unos : 0U;
+                    total += k + 1 == bitsets.size() ? unos : 0U;
+                }
+            }
+        }
+        return {parcial, total};
+    }
+
+#if PROYECTO_AVX2
+    /**
+     * @brief Version de contarInterseccion con AND de 256 bits y popcnt; solo se llama si la CPU
+     *        admite AVX2 y POPCNT.
+     */
+    __attribute__((target("avx2,popcnt"))) static pair<size_t, size_t>
+    contarInterseccionAvx2(span<const uint64_t *const> bitsets, size_t corte, size_t palabras) {
+        constexpr size_t kPalabrasPorVector = sizeof(__m256i) / sizeof(uint64_t);
+        alignas(__m256i) array<uint64_t, kPalabrasPorBloque> bloque{};
+        auto *vectores = reinterpret_cast<__m256i *>(bloque.data());
+        size_t parcial = 0;
+        size_t total = 0;
+        for (size_t inicio = 0; inicio < palabras; inicio += kPalabrasPorBloque) {
+            const auto cantidad = min(kPalabrasPorBloque, palabras - inicio);
+            const auto completos = cantidad / kPalabrasPorVector;
+            copy(bitsets[0] + inicio, bitsets[0] + inicio + cantidad, bloque.begin());
+            for (size_t k = 0; k < bitsets.size(); ++k) {
+                if (k > 0) {
+                    const auto *palabrasBitset = bitsets[k] + inicio;
+                    auto restantes = _mm256_setzero_si256();
+                    for (size_t v = 0; v < completos; ++v) {
+                        const auto otro = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i *>(palabrasBitset + v * kPalabrasPorVector));
+                        vectores[v] = _mm256_and_si256(vectores[v], otro);
+                        restantes = _mm256_or_si256(restantes, vectores[v]);
+                    }
+                    uint64_t restantesCola = 0;
+                    for (auto j = completos * kPalabrasPorVector; j < cantidad; ++j) {
+                        bloque[j] &= palabrasBitset[j];
+                        restantesCola |= bloque[j];
+                    }
+                    if (_mm256_testz_si256(restantes, restantes) != 0 && restantesCola == 0U) {
+                        break;
+                    }
+                }
+                if (k + 1 == corte || k + 1 == bitsets.size()) {
+                    size_t unos = 0;
+                    for (size_t j = 0; j < cantidad; ++j) {
+                        unos += static_cast<size_t>(_mm_popcnt_u64(bloque[j]));
+                    }
+                    parcial += k + 1 == corte ? unos : 0U;
+                    total += k + 1 == bitsets.size() ? unos : 0U;
+                }
+            }
+        }
+        return {parcial, total};
+    }
+#endif
+
+    array<vector<vector<uint64_t>>, kCantidadVariables> bitsets_;
+    array<vector<vector<uint32_t>>, kCantidadVariables> listas_;
+    array<vector<uint16_t>, kCantidadVariables> codigos_;
+    array<vector<size_t>, kCantidadVariables> cardinalidades_;
+    array<bool, kCantidadVariables> dispersa_{};
+    size_t cantidad_ = 0;
+    size_t palabras_ = 0;
+};
+
+/**
+ * @brief Consulta de probabilidad condicionada P(objetivo | evidencia) ya traducida a codigos.
+ */
+struct ConsultaProbabilidad {
+    vector<CondicionClasificacion> objetivo;
+    vector<CondicionClasificacion> evidencia;
+};
+
+/**
+ * @brief Resultado de evaluar una ConsultaProbabilidad.
+ */
+struct ResultadoConsulta {
+    size_t casos = 0;
+    size_t favorables = 0;
+};
+
+/**
+ * @brief Divide un texto por un separador que no este dentro de comillas dobles.
+ *
+ * Igual que getline, un separador final no produce una parte vacia. Las comillas se conservan en
+ * las partes; las quita leerValorCondicion.
+ * @param texto Texto a dividir.
+ * @param separador Caracter separador.
+ * @return Partes en el orden del texto.
+ * @throws runtime_error si hay comillas sin cerrar.
+ */
+vector<string> dividirFueraDeComillas(const string &texto, char separador) {
+    vector<string> partes;
+    string actual;
+    bool entreComillas = false;
+    for (const auto caracter : texto) {
+        if (caracter == '"') {
+            entreComillas = !entreComillas;
+        }
+        if (caracter == separador && !entreComillas) {
+            partes.push_back(move(actual));
+            actual.clear();
+        } else {
+            actual += caracter;
+        }
+    }
+    if (entreComillas) {
+        throw runtime_error("Comillas sin cerrar en '" + recortar(texto) + "'");
+    }
+    if (!actual.empty()) {
+        partes.push_back(move(actual));
+    }
+    return partes;
+}
+
+/**
+ * @brief Lee el valor de una condicion; entre comillas dobles puede contener ',', '|' o '=', y
+ *        "" representa una comilla.
+ * @param texto Valor tal como se escribio.
+ * @return Valor sin espacios exteriores ni comillas.
+ * @throws runtime_error si las comillas no encierran todo el valor.
+ */
+string leerValorCondicion(const string &texto) {
+    const auto valor = recortar(texto);
+    if (valor.empty() || valor.front() != '"') {
+        return valor;
+    }
+    string resultado;
+    for (size_t i = 1; i < valor.size(); ++i) {
+        if (valor[i] != '"') {
+            resultado += valor[i];
+        } else if (i + 1 < valor.size() && valor[i + 1] == '"') {
+            resultado += '"';
+            ++i;
+        } else if (i + 1 == valor.size()) {
+            return resultado;
+        } else {
+            break;
+        }
     }
+    throw runtime_error("Las comillas deben encerrar todo el valor: " + valor);
 }
 
 /**
- * @brief Devuelve el rango etiquetado para un valor de edad.
- * @param age Edad en anos.
- * @return Descripcion del rango.
+ * @brief Traduce una lista "Variable=Categoria, ..." a condiciones codificadas.
+ *
+ * La categoria se busca primero tal como se escribio y, si no existe, sin distinguir mayusculas; en
+ * ese caso debe haber una sola coincidencia.
+ * @param texto Lista de condiciones separadas por coma.
+ * @param perfiles Perfiles que definen las categorias existentes.
+ * @return Condiciones en el orden escrito.
+ * @throws runtime_error si una condicion esta mal formada, es ambigua o nombra algo inexistente.
  */
-string rangoEdad(int edad) {
-    if (edad <= 0) {
-        return "Edad desconocida";
+vector<CondicionClasificacion> analizarCondiciones(const string &texto,
+                                                  const AlmacenPerfiles &perfiles) {
+    vector<CondicionClasificacion> condiciones;
+    for (const auto &parte : dividirFueraDeComillas(texto, ',')) {
+        const auto igual = parte.find('=');
+        if (igual == string::npos) {
+            throw runtime_error("Falta '=' en la condicion '" + recortar(parte) + "'");
+        }
+        const auto nombre = recortar(parte.substr(0, igual));
+        const auto variable = variableDesdeNombre(nombre);
+        if (!variable.has_value()) {
+            throw runtime_error("Variable desconocida: " + nombre);
+        }
+        const auto valor = leerValorCondicion(parte.substr(igual + 1));
+        const auto categorias = perfiles.cantidadCategorias(variable.value());
+        optional<uint16_t> codigo;
+        for (uint16_t candidato = 0; candidato < categorias && !codigo.has_value(); ++candidato) {
+            if (perfiles.etiqueta(variable.value(), candidato) == valor) {
+                codigo = candidato;
+            }
+        }
+        const auto valorMayusculas = aMayusculas(valor);
+        for (uint16_t candidato = 0; candidato < categorias && !codigo.has_value(); ++candidato) {
+            if (aMayusculas(perfiles.etiqueta(variable.value(), candidato)) != valorMayusculas) {
+                continue;
+            }
+            for (auto otro = static_cast<uint16_t>(candidato + 1); otro < categorias; ++otro) {
+                if (aMayusculas(perfiles.etiqueta(variable.value(), otro)) == valorMayusculas) {
+                    throw runtime_error("La categoria '" + valor + "' es ambigua: escriba '" +
+                                        perfiles.etiqueta(variable.value(), candidato) + "' o '" +
+                                        perfiles.etiqueta(variable.value(), otro) + "'");
+                }
+            }
+            codigo = candidato;
+        }
+        if (!codigo.has_value()) {
+            throw runtime_error("La variable " + variableComoIdentificador(variable.value()) +
+                                " no tiene la categoria '" + valor + "'");
+        }
+        condiciones.push_back({variable.value(), codigo.value()});
     }
-    if (edad < 18) {
-        return "Menor a 18";
+    return condiciones;
+}
+
+/**
+ * @brief Analiza una consulta con la forma P(A=x, ... | B=y, ...); la parte "| ..." es opcional.
+ *
+ * Una categoria que contenga ',', '|' o '=' se escribe entre comillas dobles: P(A="x, y").
+ * @param texto Consulta escrita por el usuario.
+ * @param perfiles Perfiles que definen las variables y categorias existentes.
+ * @return Consulta codificada.
+ * @throws runtime_error si la consulta no respeta la sintaxis.
+ */
+ConsultaProbabilidad analizarConsulta(const string &texto, const AlmacenPerfiles &perfiles) {
+    auto consulta = recortar(texto);
+    if (consulta.size() < 2 || (consulta.front() != 'P' && consulta.front() != 'p')) {
+        throw runtime_error("La consulta debe empezar con P(");
     }
-    if (edad <= 30) {
-        return "18-30";
+    consulta = recortar(consulta.substr(1));
+    if (consulta.size() < 2 || consulta.front() != '(' || consulta.back() != ')') {
+        throw runtime_error("La consulta debe tener la forma P(A=x | B=y, ...)");
     }
-    if (edad <= 64) {
-        return "31-64";
+    const auto partes = dividirFueraDeComillas(consulta.substr(1, consulta.size() - 2), '|');
+    if (partes.size() > 2) {
+        throw runtime_error("La consulta tiene mas de un '|'; use comillas si la categoria lo contiene");
     }
-    return "65+";
+    ConsultaProbabilidad resultado;
+    if (!partes.empty()) {
+        resultado.objetivo = analizarCondiciones(partes[0], perfiles);
+    }
+    if (resultado.objetivo.empty()) {
+        throw runtime_error("La consulta no tiene condiciones antes de '|'");
+    }
+    if (partes.size() == 2) {
+        resultado.evidencia = analizarCondiciones(partes[1], perfiles);
+    }
+    return resultado;
 }
 
 /**
- * @brief Devuelve una etiqueta que describe el rango del promedio de notas.
- * @param promedio Promedio de notas expresado de 0 a 100.
- * @return Etiqueta del rango o "Sin historial" si no hay datos.
+ * @brief Evalua una consulta con el indice de bitmaps sin construir ningun arbol.
+ *
+ * El plan elimina condiciones repetidas, detecta contradicciones (dos categorias de la misma
+ * variable) y ordena cada grupo de condiciones de la categoria con menos estudiantes a la de mas, de
+ * modo que la interseccion se vacie lo antes posible. Si una condicion no tiene estudiantes, el
+ * resultado se conoce sin recorrer los bitmaps.
+ * @param consulta Consulta codificada.
+ * @param indice Indice de bitmaps sincronizado con los perfiles.
+ * @return Casos que cumplen la evidencia y casos que ademas cumplen el objetivo.
  */
-string rangoPromedio(const optional<double> &promedio) {
-    if (!promedio.has_value()) {
-        return "Sin historial";
+ResultadoConsulta evaluarConsulta(const ConsultaProbabilidad &consulta, const IndiceBitmap &indice) {
+    const auto contradice = [](const vector<CondicionClasificacion> &condiciones,
+                               const CondicionClasificacion &condicion) {
+        return any_of(condiciones.begin(), condiciones.end(), [&](const auto &otra) {
+            return otra.variable == condicion.variable && otra.codigo != condicion.codigo;
+        });
+    };
+    const auto contiene = [](const vector<CondicionClasificacion> &condiciones,
+                             const CondicionClasificacion &condicion) {
+        return any_of(condiciones.begin(), condiciones.end(), [&](const auto &otra) {
+            return otra.variable == condicion.variable && otra.codigo == condicion.codigo;
+        });
+    };
+    const auto porSelectividad = [&indice](const auto &a, const auto &b) {
+        return indice.cardinalidad(a) < indice.cardinalidad(b);
+    };
+
+    vector<CondicionClasificacion> evidencia;
+    for (const auto &condicion : consulta.evidencia) {
+        if (contradice(evidencia, condicion) || indice.cardinalidad(condicion) == 0) {
+            return {};
+        }
+        if (!contiene(evidencia, condicion)) {
+            evidencia.push_back(condicion);
+        }
     }
-    const double valor = clamp(promedio.value(), 0.0, 100.0);
-    if (valor < 60.0) {
-        return "0-59";
+    vector<CondicionClasificacion> objetivo;
+    bool imposible = false;
+    for (const auto &condicion : consulta.objetivo) {
+        imposible = imposible || contradice(evidencia, condicion) || contradice(objetivo, condicion) ||
+                    indice.cardinalidad(condicion) == 0;
+        if (!contiene(evidencia, condicion) && !contiene(objetivo, condicion)) {
+            objetivo.push_back(condicion);
+        }
     }
-    if (valor < 80.0) {
-        return "60-79";
+    sort(evidencia.begin(), evidencia.end(), porSelectividad);
+    sort(objetivo.begin(), objetivo.end(), porSelectividad);
+
+    if (imposible) {
+        return {evidencia.empty() ? indice.cantidad() : indice.contar(evidencia), 0U};
     }
-    return "80-100";
+    if (objetivo.empty()) {
+        const auto casos = evidencia.empty() ? indice.cantidad() : indice.contar(evidencia);
+        return {casos, casos};
+    }
+    const auto [casos, favorables] = indice.contarCondicionado(evidencia, objetivo);
+    return {casos, favorables};
 }
 
 /**
- * @brief Devuelve una etiqueta que describe el rango del porcentaje de aprobacion.
- * @param tasaAprobacion Proporcion de aprobacion como fraccion entre 0 y 1.
- * @return Etiqueta del rango o "Sin historial" si no hay datos.
+ * @brief Valor z de los intervalos de confianza del 95 % que informa el modo aproximado.
  */
-string rangoAprobacion(const optional<double> &tasaAprobacion) {
-    if (!tasaAprobacion.has_value()) {
-        return "Sin historial";
+constexpr double kZConfianza = 1.959963984540054;
+
+/**
+ * @brief Semilla de la muestra cuando no se indica otra.
+ */
+constexpr uint64_t kSemillaMuestra = 1U;
+
+/**
+ * @brief Muestra aleatoria simple, sin reemplazo, de los perfiles cargados.
+ */
+struct MuestraPerfiles {
+    size_t tamano = 0;
+    uint64_t semilla = kSemillaMuestra;
+    size_t poblacion = 0;
+    vector<size_t> indices;
+
+    /**
+     * @brief Devuelve la fraccion de la poblacion que quedo en la muestra.
+     * @return Valor entre 0 y 1; 1 si la poblacion esta vacia.
+     */
+    [[nodiscard]] double fraccion() const {
+        return poblacion == 0 ? 1.0
+                              : static_cast<double>(indices.size()) / static_cast<double>(poblacion);
     }
-    const double porcentaje = clamp(tasaAprobacion.value() * 100.0, 0.0, 100.0);
-    if (porcentaje <= 50.0) {
-        return "0-50 %";
+};
+
+/**
+ * @brief Elige una muestra uniforme sin reemplazo con el algoritmo L de muestreo de reservorio.
+ *
+ * En lugar de sortear cada elemento, el algoritmo salta al siguiente que entra al reservorio, por lo
+ * que el costo es O(tamano * (1 + log(poblacion / tamano))) y no depende linealmente de la poblacion.
+ * @param poblacion Cantidad de perfiles.
+ * @param tamano Tamano pedido; si no es menor que la poblacion, la muestra es la poblacion completa.
+ * @param semilla Semilla del generador; la misma semilla y poblacion dan la misma muestra.
+ * @return Muestra con los indices en orden creciente.
+ */
+MuestraPerfiles tomarMuestra(size_t poblacion, size_t tamano, uint64_t semilla) {
+    MuestraPerfiles muestra{tamano, semilla, poblacion, {}};
+    const auto reservorio = min(tamano, poblacion);
+    muestra.indices.resize(reservorio);
+    iota(muestra.indices.begin(), muestra.indices.end(), size_t{0});
+    if (reservorio == 0 || reservorio == poblacion) {
+        return muestra;
     }
-    if (porcentaje <= 75.0) {
-        return "51-75 %";
+    mt19937_64 generador(semilla);
+    uniform_real_distribution<double> uniforme(0.0, 1.0);
+    uniform_int_distribution<size_t> posicion(0, reservorio - 1);
+    // 1 - U evita log(0): el valor queda en (0, 1].
+    const auto aleatorio = [&] { return 1.0 - uniforme(generador); };
+    const auto k = static_cast<double>(reservorio);
+    auto peso = exp(log(aleatorio()) / k);
+    for (auto ultimo = reservorio - 1;;) {
+        const auto salto = floor(log(aleatorio()) / log1p(-peso));
+        if (!(salto < static_cast<double>(poblacion - 1 - ultimo))) {
+            break;
+        }
+        ultimo += static_cast<size_t>(salto) + 1;
+        muestra.indices[posicion(generador)] = ultimo;
+        peso *= exp(log(aleatorio()) / k);
     }
-    return "76-100 %";
+    sort(muestra.indices.begin(), muestra.indices.end());
+    return muestra;
 }
 
 /**
- * @brief Calcula la etiqueta de clasificacion de una variable usando el perfil del estudiante.
- * @param variable Variable objetivo.
- * @param profile Perfil del estudiante que contiene los datos.
- * @return Etiqueta de clasificacion.
+ * @brief Proporcion estimada con los limites de su intervalo de confianza.
  */
-string valorClasificacion(VariableClasificacion variable, const PerfilEstudiante &perfil) {
-    switch (variable) {
-        case VariableClasificacion::Genero:
-            return perfil.estudiante.genero.empty() ? "Sin registro" : perfil.estudiante.genero;
-        case VariableClasificacion::Residencia:
-            return perfil.estudiante.residencia.empty() ? "Sin registro" : perfil.estudiante.residencia;
-        case VariableClasificacion::TipoColegio:
-            return perfil.estudiante.tipoColegio.empty() ? "Sin registro" : perfil.estudiante.tipoColegio;
-        case VariableClasificacion::RangoEdad:
-            return rangoEdad(perfil.estudiante.edad);
-        case VariableClasificacion::RangoPromedio:
-            return rangoPromedio(perfil.promedio);
-        case VariableClasificacion::RangoAprobacion:
-            return rangoAprobacion(perfil.tasaAprobacion);
-        case VariableClasificacion::Trabaja:
-            return perfil.estudiante.trabaja ? "Si" : "No";
-        case VariableClasificacion::EstadoCivil:
-            return perfil.estudiante.estadoCivil.empty() ? "Sin registro"
-                                                         : perfil.estudiante.estadoCivil;
-        case VariableClasificacion::ColegioProcedencia:
-            return perfil.estudiante.colegioProcedencia.empty() ? "Sin registro"
-                                                                : perfil.estudiante.colegioProcedencia;
-        default:
-            return "Desconocido";
+struct IntervaloConfianza {
+    double estimado = 0.0;
+    double inferior = 0.0;
+    double superior = 0.0;
+};
+
+/**
+ * @brief Calcula el intervalo de Wilson del 95 % para una proporcion observada en una muestra sin
+ *        reemplazo.
+ *
+ * El valor z se multiplica por la raiz de la correccion por poblacion finita (1 - fraccion), asi el
+ * intervalo se cierra sobre el valor exacto cuando la muestra cubre toda la poblacion.
+ * @param exitos Casos de la muestra que cumplen la condicion.
+ * @param ensayos Casos de la muestra considerados.
+ * @param fraccion Fraccion de la poblacion que entro en la muestra.
+ * @return Proporcion y limites entre 0 y 1; todo 0 si no hay ensayos.
+ */
+IntervaloConfianza intervaloProporcion(size_t exitos, size_t ensayos, double fraccion) {
+    if (ensayos == 0) {
+        return {};
     }
+    const auto n = static_cast<double>(ensayos);
+    const auto p = static_cast<double>(exitos) / n;
+    const auto z = kZConfianza * sqrt(max(0.0, 1.0 - fraccion));
+    const auto z2 = z * z;
+    const auto denominador = 1.0 + z2 / n;
+    const auto centro = (p + z2 / (2.0 * n)) / denominador;
+    const auto margen = z * sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * n)) / denominador;
+    return {p, max(0.0, centro - margen), min(1.0, centro + margen)};
 }
 
 /**
- * @brief Nodo del arbol de clasificacion que almacena indices de estudiantes y relaciones jerarquicas.
+ * @brief Escribe una proporcion como porcentaje con su intervalo: "49.04% [48.10%, 49.98%]".
+ * @param salida Bufer de salida.
+ * @param intervalo Proporcion e intervalo a escribir.
  */
-struct NodoArbolClasificacion {
-    string etiqueta;
-    optional<VariableClasificacion> variable;
-    vector<size_t> indicesEstudiantes;
-    vector<unique_ptr<NodoArbolClasificacion>> hijos;
-    NodoArbolClasificacion *padre = nullptr;
-    size_t nivel = 0;
+void escribirIntervalo(SalidaBufer &salida, const IntervaloConfianza &intervalo) {
+    salida << DecimalFijo{intervalo.estimado * 100.0, 2} << "% ["
+           << DecimalFijo{intervalo.inferior * 100.0, 2} << "%, "
+           << DecimalFijo{intervalo.superior * 100.0, 2} << "%]";
+}
+
+/**
+ * @brief Evalua una consulta recorriendo solo los estudiantes de una muestra.
+ * @param consulta Consulta codificada.
+ * @param perfiles Perfiles de estudiantes.
+ * @param muestra Indices muestreados.
+ * @return Casos de la muestra que cumplen la evidencia y los que ademas cumplen el objetivo.
+ */
+ResultadoConsulta evaluarConsultaMuestra(const ConsultaProbabilidad &consulta,
+                                         const AlmacenPerfiles &perfiles,
+                                         const vector<size_t> &muestra) {
+    const auto cumple = [&perfiles](const vector<CondicionClasificacion> &condiciones, size_t i) {
+        return all_of(condiciones.begin(), condiciones.end(), [&](const auto &condicion) {
+            return perfiles.codigo(condicion.variable, i) == condicion.codigo;
+        });
+    };
+    ResultadoConsulta resultado;
+    for (const auto indice : muestra) {
+        if (cumple(consulta.evidencia, indice)) {
+            ++resultado.casos;
+            resultado.favorables += cumple(consulta.objetivo, indice) ? 1U : 0U;
+        }
+    }
+    return resultado;
+}
+
+/**
+ * @brief Referencia de solo lectura a un nodo del arbol de punteros.
+ *
+ * Junto con ReferenciaNodoPlano ofrece la interfaz comun con la que trabajan las funciones de
+ * navegacion y de reportes, independientemente de la representacion del arbol.
+ */
+class ReferenciaNodo {
+public:
+    ReferenciaNodo() = default;
+    explicit ReferenciaNodo(const NodoArbolClasificacion *nodo) : nodo_(nodo) {}
+
+    /**
+     * @brief Indica si la referencia apunta a un nodo.
+     */
+    [[nodiscard]] bool valida() const {
+        return nodo_ != nullptr;
+    }
+
+    /**
+     * @brief Devuelve la etiqueta del nodo.
+     */
+    [[nodiscard]] const string &etiqueta() const {
+        return nodo_->etiqueta;
+    }
+
+    /**
+     * @brief Devuelve la variable del nivel del nodo, o nullopt en la raiz.
+     */
+    [[nodiscard]] optional<VariableClasificacion> variable() const {
+        return nodo_->variable;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes del nodo.
+     */
+    [[nodiscard]] size_t cantidadEstudiantes() const {
+        return nodo_->indicesEstudiantes.size();
+    }
+
+    /**
+     * @brief Devuelve la cantidad de hijos del nodo.
+     */
+    [[nodiscard]] size_t cantidadHijos() const {
+        return nodo_->hijos.size();
+    }
+
+    /**
+     * @brief Devuelve el hijo en la posicion indicada.
+     */
+    [[nodiscard]] ReferenciaNodo hijo(size_t posicion) const {
+        return ReferenciaNodo(nodo_->hijos[posicion].get());
+    }
+
+    /**
+     * @brief Devuelve el padre; la referencia no es valida en la raiz.
+     */
+    [[nodiscard]] ReferenciaNodo padre() const {
+        return ReferenciaNodo(nodo_->padre);
+    }
+
+private:
+    const NodoArbolClasificacion *nodo_ = nullptr;
+};
+
+/**
+ * @brief Referencia de solo lectura a un nodo de un ArbolPlano.
+ */
+class ReferenciaNodoPlano {
+public:
+    ReferenciaNodoPlano() = default;
+    ReferenciaNodoPlano(const ArbolPlano *arbol, uint32_t id) : arbol_(arbol), id_(id) {}
+
+    /**
+     * @brief Indica si la referencia apunta a un nodo.
+     */
+    [[nodiscard]] bool valida() const {
+        return arbol_ != nullptr && id_ != ArbolPlano::kSinPadre;
+    }
+
+    /**
+     * @brief Devuelve la etiqueta del nodo.
+     */
+    [[nodiscard]] const string &etiqueta() const {
+        return arbol_->etiqueta(id_);
+    }
+
+    /**
+     * @brief Devuelve la variable del nivel del nodo, o nullopt en la raiz.
+     */
+    [[nodiscard]] optional<VariableClasificacion> variable() const {
+        return arbol_->variable(id_);
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes del nodo.
+     */
+    [[nodiscard]] size_t cantidadEstudiantes() const {
+        return arbol_->nodo(id_).fin - arbol_->nodo(id_).inicio;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de hijos del nodo.
+     */
+    [[nodiscard]] size_t cantidadHijos() const {
+        return arbol_->nodo(id_).cantidadHijos;
+    }
+
+    /**
+     * @brief Devuelve el hijo en la posicion indicada.
+     */
+    [[nodiscard]] ReferenciaNodoPlano hijo(size_t posicion) const {
+        return {arbol_, arbol_->nodo(id_).primerHijo + static_cast<uint32_t>(posicion)};
+    }
+
+    /**
+     * @brief Devuelve el padre; la referencia no es valida en la raiz.
+     */
+    [[nodiscard]] ReferenciaNodoPlano padre() const {
+        return {arbol_, arbol_->nodo(id_).padre};
+    }
+
+private:
+    const ArbolPlano *arbol_ = nullptr;
+    uint32_t id_ = ArbolPlano::kSinPadre;
+};
+
+/**
+ * @brief Referencia a un nodo virtual de un arbol cuyos conteos se leen de un CuboConteos.
+ *
+ * El nodo se identifica por los codigos elegidos en cada nivel; sus hijos son las categorias con
+ * conteo distinto de cero, en el mismo orden que en los arboles construidos.
+ */
+class ReferenciaNodoCubo {
+public:
+    ReferenciaNodoCubo() = default;
+
+    /**
+     * @brief Crea la referencia a la raiz del arbol de un orden cubierto por el cubo.
+     * @param cubo Cubo de conteos; debe cubrir el orden.
+     * @param orden Secuencia de variables de clasificacion.
+     */
+    ReferenciaNodoCubo(const CuboConteos *cubo, const vector<VariableClasificacion> &orden)
+        : cubo_(cubo), profundidad_(static_cast<uint8_t>(orden.size())),
+          celda_(cubo->celdaTotal()) {
+        for (size_t nivel = 0; nivel < orden.size(); ++nivel) {
+            dimensiones_[nivel] = static_cast<uint8_t>(cubo->dimension(orden[nivel]).value());
+        }
+    }
+
+    /**
+     * @brief Indica si la referencia apunta a un nodo.
+     */
+    [[nodiscard]] bool valida() const {
+        return cubo_ != nullptr;
+    }
+
+    /**
+     * @brief Devuelve la etiqueta del nodo.
+     */
+    [[nodiscard]] const string &etiqueta() const {
+        static const string raiz = "Poblacion total";
+        return nivel_ == 0 ? raiz : cubo_->etiqueta(dimensiones_[nivel_ - 1], codigos_[nivel_ - 1]);
+    }
+
+    /**
+     * @brief Devuelve la variable del nivel del nodo, o nullopt en la raiz.
+     */
+    [[nodiscard]] optional<VariableClasificacion> variable() const {
+        if (nivel_ == 0) {
+            return nullopt;
+        }
+        return cubo_->variable(dimensiones_[nivel_ - 1]);
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes del nodo.
+     */
+    [[nodiscard]] size_t cantidadEstudiantes() const {
+        return cubo_->conteo(celda_);
+    }
+
+    /**
+     * @brief Devuelve la cantidad de hijos del nodo.
+     */
+    [[nodiscard]] size_t cantidadHijos() const {
+        size_t cantidad = 0;
+        recorrerHijos([&cantidad](uint16_t, size_t) {
+            ++cantidad;
+            return false;
+        });
+        return cantidad;
+    }
+
+    /**
+     * @brief Devuelve el hijo en la posicion indicada.
+     */
+    [[nodiscard]] ReferenciaNodoCubo hijo(size_t posicion) const {
+        auto resultado = *this;
+        recorrerHijos([&](uint16_t codigo, size_t celda) {
+            if (posicion-- != 0) {
+                return false;
+            }
+            resultado.codigos_[nivel_] = codigo;
+            resultado.celda_ = celda;
+            ++resultado.nivel_;
+            return true;
+        });
+        return resultado;
+    }
+
+    /**
+     * @brief Devuelve el padre; la referencia no es valida en la raiz.
+     */
+    [[nodiscard]] ReferenciaNodoCubo padre() const {
+        if (nivel_ == 0) {
+            return {};
+        }
+        auto resultado = *this;
+        --resultado.nivel_;
+        const auto d = dimensiones_[resultado.nivel_];
+        resultado.celda_ += (cubo_->categorias(d) - codigos_[resultado.nivel_]) * cubo_->paso(d);
+        return resultado;
+    }
+
+private:
+    /**
+     * @brief Visita los hijos con estudiantes en orden de etiqueta hasta que visitar devuelva true.
+     * @param visitar Funcion invocada como visitar(codigo, celda).
+     */
+    template <typename Visitante>
+    void recorrerHijos(Visitante &&visitar) const {
+        if (nivel_ == profundidad_) {
+            return;
+        }
+        const auto d = dimensiones_[nivel_];
+        const auto base = celda_ - cubo_->categorias(d) * cubo_->paso(d);
+        for (const auto codigo : cubo_->codigosEnOrden(d)) {
+            const auto celda = base + codigo * cubo_->paso(d);
+            if (cubo_->conteo(celda) != 0 && visitar(codigo, celda)) {
+                return;
+            }
+        }
+    }
+
+    const CuboConteos *cubo_ = nullptr;
+    uint8_t nivel_ = 0;
+    uint8_t profundidad_ = 0;
+    array<uint8_t, kCantidadVariables> dimensiones_{};
+    array<uint16_t, kCantidadVariables> codigos_{};
+    size_t celda_ = 0;
 };
 
-/**
- * @brief Construye el arbol de clasificacion de forma recursiva.
- * @param nodo Nodo cuyos hijos seran poblados.
- * @param profiles Perfiles de estudiantes utilizados para agrupar.
- * @param orden Secuencia de variables de clasificacion.
- */
-void construirArbolRecursivo(NodoArbolClasificacion &nodo, const vector<PerfilEstudiante> &perfiles,
-                             const vector<VariableClasificacion> &orden) {
-    if (nodo.nivel >= orden.size()) {
-        return;
+/**
+ * @brief Referencia a un nodo virtual de un arbol para un orden que el cubo no cubre.
+ *
+ * Sirve para cualquier orden de variables. La raiz abarca a todos los estudiantes del IndiceBitmap;
+ * los hijos de un nodo se calculan una sola vez, la primera vez que se piden, repartiendo los
+ * estudiantes del nodo por el codigo de la siguiente variable, y cada hijo conserva su parte. Asi
+ * cada nivel cuesta lo que mide el padre y no se vuelve a intersectar la ruta desde la raiz.
+ */
+class ReferenciaNodoBitmap {
+public:
+    ReferenciaNodoBitmap() = default;
+
+    /**
+     * @brief Crea la referencia a la raiz del arbol de un orden.
+     * @param indice Indice de bitmaps sincronizado con los perfiles.
+     * @param perfiles Perfiles que aportan los codigos, las etiquetas y el orden de las categorias.
+     * @param orden Secuencia de variables de clasificacion.
+     */
+    ReferenciaNodoBitmap(const IndiceBitmap *indice, const AlmacenPerfiles *perfiles,
+                         const vector<VariableClasificacion> &orden)
+        : indice_(indice), perfiles_(perfiles), profundidad_(static_cast<uint8_t>(orden.size())),
+          conteo_(indice->cantidad()) {
+        for (size_t nivel = 0; nivel < orden.size(); ++nivel) {
+            ruta_[nivel].variable = orden[nivel];
+        }
+    }
+
+    /**
+     * @brief Indica si la referencia apunta a un nodo.
+     */
+    [[nodiscard]] bool valida() const {
+        return indice_ != nullptr;
+    }
+
+    /**
+     * @brief Devuelve la etiqueta del nodo.
+     */
+    [[nodiscard]] const string &etiqueta() const {
+        static const string raiz = "Poblacion total";
+        if (nivel_ == 0) {
+            return raiz;
+        }
+        return perfiles_->etiqueta(ruta_[nivel_ - 1].variable, ruta_[nivel_ - 1].codigo);
+    }
+
+    /**
+     * @brief Devuelve la variable del nivel del nodo, o nullopt en la raiz.
+     */
+    [[nodiscard]] optional<VariableClasificacion> variable() const {
+        if (nivel_ == 0) {
+            return nullopt;
+        }
+        return ruta_[nivel_ - 1].variable;
+    }
+
+    /**
+     * @brief Devuelve la cantidad de estudiantes del nodo.
+     */
+    [[nodiscard]] size_t cantidadEstudiantes() const {
+        return conteo_;
     }
 
-    const auto variable = orden[nodo.nivel];
-    map<string, vector<size_t>> grupos;
-    for (const auto indice : nodo.indicesEstudiantes) {
-        const auto &perfil = perfiles.at(indice);
-        const auto etiqueta = valorClasificacion(variable, perfil);
-        grupos[etiqueta].push_back(indice);
+    /**
+     * @brief Devuelve la cantidad de hijos del nodo.
+     */
+    [[nodiscard]] size_t cantidadHijos() const {
+        return hijos().size();
     }
 
-    for (auto &[etiqueta, indices] : grupos) {
-        auto hijo = make_unique<NodoArbolClasificacion>();
-        hijo->etiqueta = etiqueta;
-        hijo->variable = variable;
-        hijo->indicesEstudiantes = move(indices);
-        hijo->padre = &nodo;
-        hijo->nivel = nodo.nivel + 1;
-        construirArbolRecursivo(*hijo, perfiles, orden);
-        nodo.hijos.push_back(move(hijo));
+    /**
+     * @brief Devuelve el hijo en la posicion indicada.
+     */
+    [[nodiscard]] ReferenciaNodoBitmap hijo(size_t posicion) const {
+        return hijos()[posicion];
     }
-}
 
-/**
- * @brief Construye el arbol de clasificacion usando el orden de variables indicado.
- * @param perfiles Perfiles de estudiantes que participan en el arbol.
- * @param orden Secuencia de variables de clasificacion (niveles).
- * @return Puntero al nodo raiz.
- */
-unique_ptr<NodoArbolClasificacion>
-construirArbolClasificacion(const vector<PerfilEstudiante> &perfiles,
-                            const vector<VariableClasificacion> &orden) {
-    auto raiz = make_unique<NodoArbolClasificacion>();
-    raiz->etiqueta = "Poblacion total";
-    raiz->nivel = 0;
-    raiz->indicesEstudiantes.reserve(perfiles.size());
-    for (size_t indice = 0; indice < perfiles.size(); ++indice) {
-        raiz->indicesEstudiantes.push_back(indice);
+    /**
+     * @brief Devuelve el padre; la referencia no es valida en la raiz.
+     */
+    [[nodiscard]] ReferenciaNodoBitmap padre() const {
+        if (nivel_ == 0) {
+            return {};
+        }
+        auto resultado = *this;
+        --resultado.nivel_;
+        resultado.estudiantes_ = estudiantes_->padre;
+        resultado.conteo_ = resultado.estudiantes_ ? resultado.estudiantes_->indices.size()
+                                                   : indice_->cantidad();
+        resultado.hijos_.reset();
+        return resultado;
+    }
+
+private:
+    /**
+     * @brief Estudiantes de un nodo que no es la raiz, enlazados con los de su padre.
+     */
+    struct EstudiantesNodo {
+        vector<uint32_t> indices;
+        shared_ptr<const EstudiantesNodo> padre;
+    };
+
+    /**
+     * @brief Devuelve los hijos con estudiantes en orden de etiqueta, calculandolos la primera vez.
+     */
+    [[nodiscard]] const vector<ReferenciaNodoBitmap> &hijos() const {
+        if (hijos_) {
+            return *hijos_;
+        }
+        vector<ReferenciaNodoBitmap> hijos;
+        if (nivel_ < profundidad_ && conteo_ != 0) {
+            const auto variable = ruta_[nivel_].variable;
+            const auto &codigos = perfiles_->codigos(variable);
+            vector<vector<uint32_t>> grupos(perfiles_->cantidadCategorias(variable));
+            if (estudiantes_) {
+                for (const auto i : estudiantes_->indices) {
+                    grupos[codigos[i]].push_back(i);
+                }
+            } else {
+                for (uint32_t i = 0; i < conteo_; ++i) {
+                    grupos[codigos[i]].push_back(i);
+                }
+            }
+            for (const auto codigo : perfiles_->codigosEnOrden(variable)) {
+                if (grupos[codigo].empty()) {
+                    continue;
+                }
+                auto hijo = *this;
+                hijo.hijos_.reset();
+                hijo.ruta_[nivel_].codigo = codigo;
+                ++hijo.nivel_;
+                hijo.conteo_ = grupos[codigo].size();
+                hijo.estudiantes_ = make_shared<const EstudiantesNodo>(
+                    EstudiantesNodo{move(grupos[codigo]), estudiantes_});
+                hijos.push_back(move(hijo));
+            }
+        }
+        hijos_ = make_shared<const vector<ReferenciaNodoBitmap>>(move(hijos));
+        return *hijos_;
     }
-    construirArbolRecursivo(*raiz, perfiles, orden);
-    return raiz;
-}
+
+    const IndiceBitmap *indice_ = nullptr;
+    const AlmacenPerfiles *perfiles_ = nullptr;
+    uint8_t nivel_ = 0;
+    uint8_t profundidad_ = 0;
+    array<CondicionClasificacion, kCantidadVariables> ruta_{};
+    size_t conteo_ = 0;
+    shared_ptr<const EstudiantesNodo> estudiantes_; // nullptr en la raiz: todos los estudiantes.
+    mutable shared_ptr<const vector<ReferenciaNodoBitmap>> hijos_;
+};
 
 /**
  * @brief Recolecta todos los nodos hoja del arbol de clasificacion.
  * @param nodo Nodo examinado durante el recorrido.
  * @param hojas Coleccion de salida donde se almacenan los nodos hoja.
  */
-void recolectarHojas(const NodoArbolClasificacion &nodo,
-                     vector<const NodoArbolClasificacion *> &hojas) {
-    if (nodo.hijos.empty()) {
-        hojas.push_back(&nodo);
+template <typename Referencia>
+void recolectarHojas(Referencia nodo, vector<Referencia> &hojas) {
+    if (nodo.cantidadHijos() == 0) {
+        hojas.push_back(nodo);
         return;
     }
-    for (const auto &hijo : nodo.hijos) {
-        recolectarHojas(*hijo, hojas);
+    for (size_t posicion = 0; posicion < nodo.cantidadHijos(); ++posicion) {
+        recolectarHojas(nodo.hijo(posicion), hojas);
     }
 }
 
@@ -655,81 +5855,274 @@ void recolectarHojas(const NodoArbolClasificacion &nodo,
  * @param nodo Nodo objetivo.
  * @return Vector con los nodos desde la raiz hasta el nodo indicado.
  */
-vector<const NodoArbolClasificacion *> rutaHastaRaiz(const NodoArbolClasificacion *nodo) {
-    vector<const NodoArbolClasificacion *> ruta;
+template <typename Referencia>
+vector<Referencia> rutaHastaRaiz(Referencia nodo) {
+    vector<Referencia> ruta;
     auto actual = nodo;
-    while (actual != nullptr) {
+    while (actual.valida()) {
         ruta.push_back(actual);
-        actual = actual->padre;
+        actual = actual.padre();
     }
     reverse(ruta.begin(), ruta.end());
     return ruta;
 }
 
+/**
+ * @brief Recorre el arbol en preorden con una pila explicita que guarda la ruta actual.
+ *
+ * Los hijos se visitan en su orden, igual que recolectarHojas, y la ruta de cada nodo sale de la
+ * pila sin volver a subir por sus padres ni reservar memoria por nodo.
+ * @param raiz Nodo raiz del arbol.
+ * @param visitar Funcion invocada como visitar(ruta); ruta va de la raiz al nodo visitado y solo es
+ *        valida durante la llamada.
+ */
+template <typename Referencia, typename Visitante>
+void recorrerEnProfundidad(Referencia raiz, Visitante &&visitar) {
+    vector<Referencia> ruta{raiz};
+    vector<size_t> siguienteHijo{0};
+    visitar(static_cast<const vector<Referencia> &>(ruta));
+    while (!ruta.empty()) {
+        const auto posicion = siguienteHijo.back();
+        if (posicion == ruta.back().cantidadHijos()) {
+            ruta.pop_back();
+            siguienteHijo.pop_back();
+            continue;
+        }
+        ++siguienteHijo.back();
+        ruta.push_back(ruta.back().hijo(posicion));
+        siguienteHijo.push_back(0);
+        visitar(static_cast<const vector<Referencia> &>(ruta));
+    }
+}
+
+/**
+ * @brief Formato de archivo de exportarArbol.
+ */
+enum class FormatoExportacion {
+    Csv,
+    Json
+};
+
+/**
+ * @brief Escribe el arbol en CSV o JSON en un solo recorrido en profundidad.
+ *
+ * Cada nodo (o solo cada hoja) produce una fila con nivel, ruta, variable, etiqueta, cantidad de
+ * estudiantes, porcentaje sobre el total y porcentaje condicionado al padre. En CSV la ruta usa el
+ * formato del reporte por hojas ("Variable=etiqueta -> ..."); en JSON es un arreglo de tramos
+ * "Variable=etiqueta" y el documento es un arreglo con un objeto por linea. El texto de la ruta se
+ * mantiene como pila: al bajar se anade un tramo y al subir se recorta.
+ * @param raiz Nodo raiz del arbol.
+ * @param formato CSV o JSON.
+ * @param soloHojas true para escribir solo las hojas.
+ * @param salida Bufer de salida.
+ * @return Cantidad de filas escritas.
+ */
+template <typename Referencia>
+size_t exportarArbol(Referencia raiz, FormatoExportacion formato, bool soloHojas,
+                     SalidaBufer &salida) {
+    const auto esCsv = formato == FormatoExportacion::Csv;
+    const auto porcentaje = [](size_t parte, size_t todo) {
+        const auto base = static_cast<double>(todo);
+        return DecimalFijo{base == 0.0 ? 0.0 : static_cast<double>(parte) / base * 100.0, 4};
+    };
+    // Pila de la ruta: textoRuta tiene los tramos ya formateados y cortesRuta donde termina cada uno.
+    string textoRuta;
+    vector<size_t> cortesRuta;
+    vector<string> nombresNivel;
+    string campo;
+    size_t filas = 0;
+    if (esCsv) {
+        salida << "nivel,ruta,variable,etiqueta,estudiantes,porcentajeTotal,porcentajeCondicionado,"
+                  "hoja\n";
+    } else {
+        salida << '[';
+    }
+    recorrerEnProfundidad(raiz, [&](const vector<Referencia> &ruta) {
+        const auto &nodo = ruta.back();
+        const auto nivel = ruta.size() - 1;
+        cortesRuta.resize(nivel);
+        textoRuta.resize(cortesRuta.empty() ? 0 : cortesRuta.back());
+        if (nombresNivel.size() <= nivel) {
+            nombresNivel.push_back(nodo.variable().has_value()
+                                       ? variableComoCadena(nodo.variable().value())
+                                       : string());
+        }
+        const auto &nombreVariable = nombresNivel[nivel];
+        if (nivel > 0) {
+            if (esCsv) {
+                textoRuta.append(nivel > 1 ? " -> " : "").append(nombreVariable).append("=");
+                textoRuta.append(nodo.etiqueta());
+            } else {
+                textoRuta.append(nivel > 1 ? ",\"" : "\"");
+                anexarEscapadoJson(textoRuta, nombreVariable);
+                textoRuta.push_back('=');
+                anexarEscapadoJson(textoRuta, nodo.etiqueta());
+                textoRuta.push_back('"');
+            }
+        }
+        cortesRuta.push_back(textoRuta.size());
+        const auto esHoja = nodo.cantidadHijos() == 0;
+        if (soloHojas && !esHoja) {
+            return;
+        }
+        const auto estudiantes = nodo.cantidadEstudiantes();
+        const auto condicionado = nivel == 0
+                                      ? DecimalFijo{100.0, 4}
+                                      : porcentaje(estudiantes, ruta[nivel - 1].cantidadEstudiantes());
+        const auto sobreTotal = porcentaje(estudiantes, raiz.cantidadEstudiantes());
+        campo.clear();
+        if (esCsv) {
+            anexarCampoCsv(campo, textoRuta);
+            campo.push_back(',');
+            anexarCampoCsv(campo, nombreVariable);
+            campo.push_back(',');
+            anexarCampoCsv(campo, nodo.etiqueta());
+            salida << nivel << ',' << campo << ',' << estudiantes << ',' << sobreTotal << ','
+                   << condicionado << ',' << (esHoja ? "1" : "0") << '\n';
+        } else {
+            campo.append("],\"variable\":");
+            if (nombreVariable.empty()) {
+                campo.append("null");
+            } else {
+                campo.push_back('"');
+                anexarEscapadoJson(campo, nombreVariable);
+                campo.push_back('"');
+            }
+            campo.append(",\"etiqueta\":\"");
+            anexarEscapadoJson(campo, nodo.etiqueta());
+            campo.push_back('"');
+            salida << (filas == 0 ? "\n" : ",\n") << "{\"nivel\":" << nivel << ",\"ruta\":["
+                   << textoRuta << campo << ",\"estudiantes\":" << estudiantes
+                   << ",\"porcentajeTotal\":" << sobreTotal
+                   << ",\"porcentajeCondicionado\":" << condicionado
+                   << ",\"hoja\":" << (esHoja ? "true" : "false") << '}';
+        }
+        ++filas;
+    });
+    salida << (esCsv ? "" : "\n]\n");
+    return filas;
+}
+
 /**
  * @brief Imprime el arbol de clasificacion por niveles.
- * @param root Nodo raiz del arbol.
+ * @param raiz Nodo raiz del arbol.
  */
-void imprimirArbolPorNiveles(const NodoArbolClasificacion &raiz) {
-    queue<const NodoArbolClasificacion *> cola;
-    cola.push(&raiz);
+template <typename Referencia>
+void imprimirArbolPorNiveles(Referencia raiz) {
+    MEDIR_FASE(FaseMedida::FormatoSalida);
+    SalidaBufer salida(cout);
+    queue<Referencia> cola;
+    cola.push(raiz);
     size_t nivelActual = 0;
 
     while (!cola.empty()) {
         const auto cantidadNivel = cola.size();
-        cout << "Nivel " << nivelActual << ":\n";
+        salida << "Nivel " << nivelActual << ":\n";
         for (size_t i = 0; i < cantidadNivel; ++i) {
             const auto nodo = cola.front();
             cola.pop();
 
-            string descriptor;
-            if (!nodo->variable.has_value()) {
-                descriptor = nodo->etiqueta;
+            salida << "  - ";
+            if (nodo.variable().has_value()) {
+                salida << variableComoCadena(nodo.variable().value()) << " = ";
+            }
+            salida << nodo.etiqueta() << " (" << nodo.cantidadEstudiantes() << " estudiantes)\n";
+            for (size_t posicion = 0; posicion < nodo.cantidadHijos(); ++posicion) {
+                cola.push(nodo.hijo(posicion));
+            }
+        }
+        ++nivelActual;
+    }
+    salida << '\n';
+}
+
+/**
+ * @brief Imprime por niveles un arbol construido sobre una muestra, con estimaciones e intervalos.
+ *
+ * Cada nodo muestra la cantidad estimada en la poblacion, su porcentaje sobre el total y su
+ * porcentaje condicionado al padre, ambos con el intervalo de confianza del 95 %.
+ * @param raiz Nodo raiz del arbol muestral.
+ * @param muestra Muestra con la que se construyo el arbol.
+ */
+template <typename Referencia>
+void imprimirArbolAproximado(Referencia raiz, const MuestraPerfiles &muestra) {
+    MEDIR_FASE(FaseMedida::FormatoSalida);
+    SalidaBufer salida(cout);
+    salida << "Estimaciones con una muestra de " << muestra.indices.size() << " de "
+           << muestra.poblacion << " estudiantes (intervalos de confianza del 95%)\n";
+    queue<pair<Referencia, size_t>> cola;
+    cola.push({raiz, raiz.cantidadEstudiantes()});
+    size_t nivelActual = 0;
+    while (!cola.empty()) {
+        const auto cantidadNivel = cola.size();
+        salida << "Nivel " << nivelActual << ":\n";
+        for (size_t i = 0; i < cantidadNivel; ++i) {
+            const auto [nodo, conteoPadre] = cola.front();
+            cola.pop();
+            const auto conteo = nodo.cantidadEstudiantes();
+            salida << "  - ";
+            if (!nodo.variable().has_value()) {
+                salida << nodo.etiqueta() << " (" << muestra.poblacion << " estudiantes)\n";
             } else {
-                descriptor =
-                    variableComoCadena(nodo->variable.value()) + " = " + nodo->etiqueta;
+                const auto total =
+                    intervaloProporcion(conteo, raiz.cantidadEstudiantes(), muestra.fraccion());
+                const auto estimados = llround(total.estimado * static_cast<double>(muestra.poblacion));
+                salida << variableComoCadena(nodo.variable().value()) << " = " << nodo.etiqueta()
+                       << " (~" << estimados << " estudiantes; total ";
+                escribirIntervalo(salida, total);
+                salida << "; condicionado ";
+                escribirIntervalo(salida, intervaloProporcion(conteo, conteoPadre, muestra.fraccion()));
+                salida << ")\n";
             }
-            cout << "  - " << descriptor << " (" << nodo->indicesEstudiantes.size()
-                      << " estudiantes)\n";
-            for (const auto &hijo : nodo->hijos) {
-                cola.push(hijo.get());
+            for (size_t posicion = 0; posicion < nodo.cantidadHijos(); ++posicion) {
+                cola.push({nodo.hijo(posicion), conteo});
             }
         }
         ++nivelActual;
     }
-    cout << endl;
+    salida << '\n';
 }
 
 /**
- * @brief Imprime un perfil de estudiante combinando datos personales e historial academico.
- * @param profile Perfil de estudiante a mostrar.
+ * @brief Escribe un perfil de estudiante combinando datos personales e historial academico.
+ * @param salida Bufer de salida.
+ * @param perfiles Almacen que contiene el perfil.
+ * @param indice Indice del estudiante a mostrar.
+ * @param recorrerDisco Funcion recorrerDisco(visitar) que entrega a visitar cada registro del
+ *        estudiante leido del disco; solo se usa cuando el almacen solo guarda acumulados.
  */
-void imprimirPerfil(const PerfilEstudiante &perfil) {
-    const auto &estudiante = perfil.estudiante;
-    cout << "Carne: " << estudiante.carne << " | Genero: " << estudiante.genero
-              << " | Residencia: " << estudiante.residencia << " | Edad: " << estudiante.edad
-              << " | Colegio origen: " << estudiante.colegioProcedencia
-              << " | Tipo colegio: " << estudiante.tipoColegio
-              << " | Trabaja: " << (estudiante.trabaja ? "Si" : "No")
-              << " | Estado civil: " << estudiante.estadoCivil << '\n';
+template <typename RecorrerDisco>
+void imprimirPerfil(SalidaBufer &salida, const AlmacenPerfiles &perfiles, size_t indice,
+                    RecorrerDisco &&recorrerDisco) {
+    salida << "Carne: " << perfiles.carne(indice) << " | Genero: " << perfiles.genero(indice)
+           << " | Residencia: " << perfiles.residencia(indice) << " | Edad: " << perfiles.edad(indice)
+           << " | Colegio origen: " << perfiles.colegioProcedencia(indice)
+           << " | Tipo colegio: " << perfiles.tipoColegio(indice)
+           << " | Trabaja: " << (perfiles.trabaja(indice) ? "Si" : "No")
+           << " | Estado civil: " << perfiles.estadoCivil(indice) << '\n';
 
-    if (perfil.historial.empty()) {
-        cout << "  Historial: Sin registros.\n";
+    if (perfiles.cantidadHistorial(indice) == 0) {
+        salida << "  Historial: Sin registros.\n";
         return;
     }
 
-    cout << "  Historial (" << perfil.historial.size() << " registros):\n";
-    for (const auto &entrada : perfil.historial) {
-        cout << "    - Semestre " << entrada.semestre << " | Materia: " << entrada.materia
-                  << " | Nota: " << fixed << setprecision(2) << entrada.nota << '\n';
+    salida << "  Historial (" << perfiles.cantidadHistorial(indice) << " registros):\n";
+    const auto imprimirRegistro = [&salida](int semestre, string_view materia, double nota) {
+        salida << "    - Semestre " << semestre << " | Materia: " << materia
+               << " | Nota: " << DecimalFijo{nota, 2} << '\n';
+    };
+    if (perfiles.historialEnMemoria()) {
+        perfiles.recorrerHistorial(indice, imprimirRegistro);
+    } else {
+        recorrerDisco([&](const VistaRegistroHistorial &vista) {
+            imprimirRegistro(vista.semestre, vista.materia, vista.nota);
+        });
     }
-    if (perfil.promedio.has_value()) {
-        cout << "  Promedio: " << fixed << setprecision(2)
-                  << perfil.promedio.value() << '\n';
+    if (const auto promedio = perfiles.promedio(indice); promedio.has_value()) {
+        salida << "  Promedio: " << DecimalFijo{promedio.value(), 2} << '\n';
     }
-    if (perfil.tasaAprobacion.has_value()) {
-        cout << "  % Aprobacion: " << fixed << setprecision(2)
-                  << perfil.tasaAprobacion.value() * 100.0 << "%\n";
+    if (const auto tasaAprobacion = perfiles.tasaAprobacion(indice); tasaAprobacion.has_value()) {
+        salida << "  % Aprobacion: " << DecimalFijo{tasaAprobacion.value() * 100.0, 2} << "%\n";
     }
 }
 
@@ -738,10 +6131,9 @@ void imprimirPerfil(const PerfilEstudiante &perfil) {
  * @param repositorioEstudiantes Repositorio de estudiantes.
  * @param repositorioHistorial Repositorio de historial.
  */
-void precargarDatos(const RepositorioEstudiantes &repositorioEstudiantes,
-                    const RepositorioHistorial &repositorioHistorial) {
-    if (tamanoArchivoSeguro(repositorioEstudiantes.ruta()) > 0 &&
-        tamanoArchivoSeguro(repositorioHistorial.ruta()) > 0) {
+void precargarDatos(RepositorioEstudiantes &repositorioEstudiantes,
+                    RepositorioHistorial &repositorioHistorial) {
+    if (!repositorioEstudiantes.vacio() && !repositorioHistorial.vacio()) {
         return;
     }
 
@@ -776,6 +6168,156 @@ void precargarDatos(const RepositorioEstudiantes &repositorioEstudiantes,
             repositorioHistorial.agregar(registro);
         }
     }
+    repositorioEstudiantes.confirmar();
+    repositorioHistorial.confirmar();
+}
+
+/**
+ * @brief Parametros del generador de datos sinteticos.
+ */
+struct ConfiguracionGenerador {
+    size_t estudiantes = 1000;
+    size_t registros = 4000;
+    uint64_t semilla = 42;
+};
+
+/**
+ * @brief Distribucion discreta con pesos 1 / (k + 1)^sesgo sobre k = 0..cantidad-1 (ley de Zipf).
+ * @param cantidad Cantidad de categorias.
+ * @param sesgo Exponente; 0 da una distribucion uniforme.
+ * @return Distribucion lista para muestrear indices.
+ */
+discrete_distribution<size_t> distribucionZipf(size_t cantidad, double sesgo) {
+    vector<double> pesos(cantidad);
+    for (size_t k = 0; k < cantidad; ++k) {
+        pesos[k] = 1.0 / pow(static_cast<double>(k + 1), sesgo);
+    }
+    return discrete_distribution<size_t>(pesos.begin(), pesos.end());
+}
+
+/**
+ * @brief Anade estudiantes y registros de historial sinteticos directamente a los repositorios.
+ *
+ * Las categorias siguen proporciones sesgadas (Zipf para residencia, colegio y materia; pesos fijos
+ * para genero, tipo de colegio y estado civil), la edad se concentra alrededor de 21 anos, la
+ * probabilidad de trabajar crece con la edad y cada estudiante tiene un nivel propio alrededor del
+ * cual varian sus notas. Los registros se reparten al azar entre los estudiantes nuevos, de modo
+ * que el historial queda intercalado como en un archivo real. La escritura se hace en lotes sin
+ * fsync y al final se confirma con la politica que tenian los repositorios; los carnes continuan la
+ * numeracion de los estudiantes existentes.
+ * @param repositorioEstudiantes Repositorio de estudiantes.
+ * @param repositorioHistorial Repositorio de historial.
+ * @param configuracion Cantidades y semilla.
+ * @throws runtime_error si un carne generado ya existe o falla la escritura.
+ */
+void generarDatosSinteticos(RepositorioEstudiantes &repositorioEstudiantes,
+                            RepositorioHistorial &repositorioHistorial,
+                            const ConfiguracionGenerador &configuracion) {
+    constexpr size_t kLote = 65536;
+    const array<const char *, 3> generos = {"Femenino", "Masculino", "No binario"};
+    const array<const char *, 7> residencias = {"San Jose",  "Alajuela",   "Cartago", "Heredia",
+                                                "Guanacaste", "Puntarenas", "Limon"};
+    const array<const char *, 3> tiposColegio = {"Publico", "Privado", "Tecnico"};
+    const array<const char *, 4> estadosCiviles = {"Soltero", "Casado", "Union libre", "Divorciado"};
+    constexpr size_t kColegios = 250;
+    constexpr size_t kMaterias = 80;
+
+    mt19937_64 generador(configuracion.semilla);
+    discrete_distribution<size_t> genero({49.0, 49.0, 2.0});
+    auto residencia = distribucionZipf(residencias.size(), 1.0);
+    discrete_distribution<size_t> tipoColegio({68.0, 22.0, 10.0});
+    discrete_distribution<size_t> estadoCivil({85.0, 10.0, 4.0, 1.0});
+    auto colegio = distribucionZipf(kColegios, 1.1);
+    auto materia = distribucionZipf(kMaterias, 0.8);
+    normal_distribution<double> edad(21.0, 3.5);
+    normal_distribution<double> nivel(74.0, 9.0);
+    normal_distribution<double> variacion(0.0, 10.0);
+    uniform_real_distribution<double> uniforme(0.0, 1.0);
+    uniform_int_distribution<int> semestre(1, 12);
+
+    const auto politicaEstudiantes = repositorioEstudiantes.politicaEscritura();
+    const auto politicaHistorial = repositorioHistorial.politicaEscritura();
+    PoliticaEscritura politicaLote;
+    politicaLote.sincronizacion = SincronizacionDisco::Ninguna;
+    repositorioEstudiantes.establecerPoliticaEscritura(politicaLote);
+    repositorioHistorial.establecerPoliticaEscritura(politicaLote);
+
+    const auto primero = repositorioEstudiantes.cantidad();
+    vector<string> carnes(configuracion.estudiantes);
+    vector<float> niveles(configuracion.estudiantes);
+    vector<Estudiante> lote;
+    lote.reserve(min(kLote, configuracion.estudiantes));
+    for (size_t i = 0; i < configuracion.estudiantes; ++i) {
+        auto numero = to_string(primero + i + 1);
+        carnes[i] = "S" + string(numero.size() < 8 ? 8 - numero.size() : 0, '0') + numero;
+        niveles[i] = static_cast<float>(clamp(nivel(generador), 35.0, 98.0));
+
+        Estudiante estudiante;
+        estudiante.carne = carnes[i];
+        estudiante.genero = generos[genero(generador)];
+        estudiante.residencia = residencias[residencia(generador)];
+        estudiante.edad = static_cast<int>(clamp(lround(edad(generador)), 16L, 65L));
+        estudiante.colegioProcedencia = "Colegio " + to_string(colegio(generador) + 1);
+        estudiante.tipoColegio = tiposColegio[tipoColegio(generador)];
+        estudiante.trabaja = uniforme(generador) < min(0.85, 0.1 + 0.06 * (estudiante.edad - 17));
+        estudiante.estadoCivil = estadosCiviles[estadoCivil(generador)];
+        lote.push_back(move(estudiante));
+        if (lote.size() == kLote || i + 1 == configuracion.estudiantes) {
+            repositorioEstudiantes.agregarLote(lote);
+            repositorioEstudiantes.confirmar();
+            lote.clear();
+        }
+    }
+
+    if (!carnes.empty()) {
+        uniform_int_distribution<size_t> dueno(0, carnes.size() - 1);
+        vector<RegistroHistorial> registros;
+        registros.reserve(min(kLote, configuracion.registros));
+        for (size_t k = 0; k < configuracion.registros; ++k) {
+            const auto estudiante = dueno(generador);
+            RegistroHistorial registro;
+            registro.carneEstudiante = carnes[estudiante];
+            registro.semestre = semestre(generador);
+            registro.materia = "Curso " + to_string(materia(generador) + 1);
+            registro.nota = clamp(round(niveles[estudiante] + variacion(generador)), 0.0, 100.0);
+            registros.push_back(move(registro));
+            if (registros.size() == kLote || k + 1 == configuracion.registros) {
+                repositorioHistorial.agregarLote(registros);
+                registros.clear();
+            }
+        }
+    }
+    repositorioHistorial.confirmar();
+    repositorioEstudiantes.establecerPoliticaEscritura(politicaEstudiantes);
+    repositorioHistorial.establecerPoliticaEscritura(politicaHistorial);
+    // Con la politica restaurada, confirmar sincroniza lo escrito si esta lo pide.
+    repositorioEstudiantes.confirmar();
+    repositorioHistorial.confirmar();
+}
+
+/**
+ * @brief Representaciones disponibles para el arbol de clasificacion activo.
+ */
+enum class RepresentacionArbol {
+    Punteros,
+    Plano,
+    Cubo
+};
+
+/**
+ * @brief Devuelve el nombre legible de una representacion de arbol.
+ * @param representacion Representacion que se desea describir.
+ * @return Nombre para mostrar.
+ */
+string representacionComoCadena(RepresentacionArbol representacion) {
+    switch (representacion) {
+        case RepresentacionArbol::Plano:
+            return "plana";
+        case RepresentacionArbol::Cubo:
+            return "cubo de conteos";
+        default:
+            return "punteros";
+    }
 }
 
 /**
@@ -783,14 +6325,18 @@ void precargarDatos(const RepositorioEstudiantes &repositorioEstudiantes,
  */
 class Aplicacion {
 public:
-    Aplicacion()
-        : repositorioEstudiantes_(kArchivoEstudiantes),
-          repositorioHistorial_(kArchivoHistorial),
-          perfiles_(cargarPerfiles(repositorioEstudiantes_, repositorioHistorial_)) {
-        repositorioEstudiantes_.asegurarArchivo();
-        repositorioHistorial_.asegurarArchivo();
+    explicit Aplicacion(ModoCargaPerfiles modoCarga = ModoCargaPerfiles::Completa,
+                        SincronizacionDisco sincronizacion = SincronizacionDisco::AlConfirmar)
+        : modoCarga_(modoCarga),
+          repositorioEstudiantes_(kArchivoEstudiantes),
+          repositorioHistorial_(kArchivoHistorial) {
+        PoliticaEscritura politica;
+        politica.sincronizacion = sincronizacion;
+        repositorioEstudiantes_.establecerPoliticaEscritura(politica);
+        repositorioHistorial_.establecerPoliticaEscritura(politica);
         precargarDatos(repositorioEstudiantes_, repositorioHistorial_);
-        perfiles_ = cargarPerfiles(repositorioEstudiantes_, repositorioHistorial_);
+        perfiles_ = cargarPerfiles(repositorioEstudiantes_, repositorioHistorial_, pool_, modoCarga_);
+        reconstruirCubo();
     }
 
     /**
@@ -815,6 +6361,16 @@ public:
                 opcionAgregarEstudiante();
             } else if (opcion == "7") {
                 opcionAgregarNota();
+            } else if (opcion == "8") {
+                opcionCambiarRepresentacion();
+            } else if (opcion == "9") {
+                opcionConsultarProbabilidad();
+            } else if (opcion == "10") {
+                Estadisticas::global().imprimirTabla(cout);
+            } else if (opcion == "11") {
+                opcionExportarArbol();
+            } else if (opcion == "12") {
+                opcionModoAproximado();
             } else if (opcion == "0") {
                 enEjecucion = false;
             } else {
@@ -824,17 +6380,99 @@ public:
         cout << "Hasta pronto.\n";
     }
 
+    /**
+     * @brief Ejecuta, sin menu ni solicitudes, los comandos de un guion (uno por linea).
+     *
+     * Las lineas vacias y las que empiezan con '#' se ignoran. Un comando invalido se informa por
+     * cerr y no detiene el guion.
+     * @param comandos Flujo con los comandos.
+     * @return 0 si todos los comandos se ejecutaron; 1 si alguno fallo.
+     */
+    int ejecutarLote(istream &comandos) {
+        enLote_ = true;
+        int codigoSalida = 0;
+        string linea;
+        while (getline(comandos, linea)) {
+            linea = recortar(linea);
+            if (linea.empty() || linea.front() == '#') {
+                continue;
+            }
+            try {
+                ejecutarComando(linea);
+            } catch (const exception &ex) {
+                cerr << "Comando '" << linea << "': " << ex.what() << '\n';
+                codigoSalida = 1;
+            }
+        }
+        cout.flush();
+        return codigoSalida;
+    }
+
+    /**
+     * @brief Muestra los comandos aceptados por el modo por lotes.
+     * @param salida Flujo donde se escribe la ayuda.
+     */
+    static void imprimirAyudaLote(ostream &salida) {
+        salida << "Uso: Proyecto_Estructuras_2 [--solo-agregados] [--stats[=json]]\n"
+               << "                           [--fsync ninguna|confirmar|siempre]\n"
+               << "                           [--script archivo | comando ...]\n"
+               << "Sin argumentos se abre el menu interactivo. Con --script se leen los comandos del\n"
+               << "archivo (o de la entrada estandar si es '-'); si no, cada argumento es un comando.\n"
+               << "--solo-agregados guarda en memoria solo los totales del historial de cada\n"
+               << "estudiante y lee el detalle del disco al mostrar un perfil.\n"
+               << "--stats escribe en cerr, al salir, los tiempos por fase y los contadores de trabajo\n"
+               << "(en JSON con --stats=json).\n"
+               << "--fsync elige cuando se llevan a disco las escrituras: nunca, al confirmar cada\n"
+               << "alta o comando (por defecto) o tambien en cada volcado automatico del bufer.\n"
+               << "Comandos:\n"
+               << "  arbol Variable1,Variable2,...   Construye el arbol con ese orden\n"
+               << "  representacion punteros|plana|cubo\n"
+               << "  imprimir                        Imprime el arbol por niveles\n"
+               << "  hojas [limite [desde]]          Totales y porcentajes por hoja\n"
+               << "  consulta P(A=x | B=y, ...)      Probabilidad condicionada\n"
+               << "  perfiles [limite [desde]]       Lista estudiantes e historial\n"
+               << "  importar estudiantes <csv>      carne,genero,residencia,edad,colegio,\n"
+               << "                                  tipoColegio,trabaja,estadoCivil\n"
+               << "  importar historial <csv>        carne,semestre,materia,nota\n"
+               << "  compactar                       Ordena historial.bin por carne y semestre\n"
+               << "  generar <estudiantes> <registros> [semilla]\n"
+               << "                                  Anade datos sinteticos con categorias sesgadas\n"
+               << "  exportar csv|json <archivo> [hojas]\n"
+               << "                                  Escribe cada nodo (o cada hoja) con su ruta,\n"
+               << "                                  total y porcentajes\n"
+               << "  muestra <tamano> [semilla]      Modo aproximado sobre una muestra aleatoria,\n"
+               << "                                  con intervalos del 95%; 0 vuelve al exacto\n"
+               << "  exacta Variable=valor,...       Conteos exactos de una ruta del arbol\n"
+               << "  estadisticas [json|reiniciar]   Tiempos por fase y contadores de trabajo\n"
+               << "Variables: Genero, Residencia, TipoColegio, RangoEdad, RangoPromedio,\n"
+               << "           RangoAprobacion, Trabaja, EstadoCivil, ColegioProcedencia\n";
+    }
+
 private:
+    // El pool se declara primero para que exista durante la carga inicial de perfiles.
+    PoolTrabajo pool_;
+    ModoCargaPerfiles modoCarga_;
     RepositorioEstudiantes repositorioEstudiantes_;
     RepositorioHistorial repositorioHistorial_;
-    vector<PerfilEstudiante> perfiles_;
+    AlmacenPerfiles perfiles_;
     vector<VariableClasificacion> ordenActivo_;
     unique_ptr<NodoArbolClasificacion> arbolActual_;
+    shared_ptr<const ArbolPlano> arbolPlano_;
+    CacheArboles cacheArboles_;
+    CuboConteos cubo_;
+    // Se construye con la primera consulta que lo necesita; ver indiceBitmap().
+    optional<IndiceBitmap> bitmap_;
+    bool arbolEnCubo_ = false;
+    bool arbolEnBitmap_ = false;
+    RepresentacionArbol representacion_ = RepresentacionArbol::Punteros;
+    optional<MuestraPerfiles> muestra_;
+    // En modo por lotes los errores se lanzan para que ejecutarLote los informe y devuelva 1.
+    bool enLote_ = false;
 
     /**
      * @brief Imprime las opciones del menu principal.
      */
-    static void imprimirMenuPrincipal() {
+    void imprimirMenuPrincipal() const {
         cout << "\n=== Clasificacion de Estudiantes ===\n";
         cout << "1. Construir un nuevo arbol de clasificacion\n";
         cout << "2. Imprimir arbol por niveles\n";
@@ -843,97 +6481,424 @@ private:
         cout << "5. Listar estudiantes y su historial\n";
         cout << "6. Registrar nuevo estudiante\n";
         cout << "7. Registrar nueva nota en historial\n";
+        cout << "8. Cambiar representacion del arbol (actual: "
+                  << representacionComoCadena(representacion_) << ")\n";
+        cout << "9. Consultar probabilidad condicionada\n";
+        cout << "10. Ver estadisticas de rendimiento\n";
+        cout << "11. Exportar arbol a CSV o JSON\n";
+        cout << "12. Modo aproximado por muestreo (actual: ";
+        if (muestra_.has_value()) {
+            cout << "muestra de " << muestra_->indices.size() << ")\n";
+        } else {
+            cout << "exacto)\n";
+        }
         cout << "0. Salir\n";
     }
 
     /**
-     * @brief Solicita entrada al usuario y recorta la respuesta.
-     * @param mensaje Mensaje mostrado antes de esperar la entrada.
-     * @return Entrada del usuario sin espacios (posiblemente vacia).
+     * @brief Solicita entrada al usuario y recorta la respuesta.
+     * @param mensaje Mensaje mostrado antes de esperar la entrada.
+     * @return Entrada del usuario sin espacios (posiblemente vacia).
+     */
+    static string solicitar(const string &mensaje) {
+        cout << mensaje << ": ";
+        string texto;
+        getline(cin, texto);
+        return recortar(texto);
+    }
+
+    /**
+     * @brief Pregunta hasta que el usuario proporcione una respuesta no vacia.
+     * @param mensaje Mensaje mostrado al usuario.
+     * @return Cadena no vacia.
+     */
+    static string solicitarNoVacio(const string &mensaje) {
+        while (true) {
+            const auto valor = solicitar(mensaje);
+            if (!valor.empty()) {
+                return valor;
+            }
+            cout << "El valor no puede estar vacio. Intente nuevamente.\n";
+        }
+    }
+
+    /**
+     * @brief Solicita al usuario un entero dentro de un rango.
+     * @param mensaje Mensaje mostrado al solicitar datos.
+     * @param valorMinimo Valor minimo aceptado.
+     * @param valorMaximo Valor maximo aceptado.
+     * @return Entero valido dentro del rango.
+     */
+    static int solicitarEntero(const string &mensaje, int valorMinimo, int valorMaximo) {
+        while (true) {
+            const auto valor = solicitar(mensaje);
+            try {
+                const int numero = stoi(valor);
+                if (numero < valorMinimo || numero > valorMaximo) {
+                    throw out_of_range("Fuera de rango");
+                }
+                return numero;
+            } catch (const exception &) {
+                cout << "Valor invalido. Ingrese un numero entre " << valorMinimo << " y "
+                          << valorMaximo << ".\n";
+            }
+        }
+    }
+
+    /**
+     * @brief Solicita al usuario un valor flotante dentro de un rango.
+     * @param mensaje Mensaje mostrado al solicitar datos.
+     * @param valorMinimo Valor minimo aceptado.
+     * @param valorMaximo Valor maximo aceptado.
+     * @return Numero valido dentro del rango.
+     */
+    static double solicitarDoble(const string &mensaje, double valorMinimo, double valorMaximo) {
+        while (true) {
+            const auto valor = solicitar(mensaje);
+            try {
+                const double numero = stod(valor);
+                if (numero < valorMinimo || numero > valorMaximo) {
+                    throw out_of_range("Fuera de rango");
+                }
+                return numero;
+            } catch (const exception &) {
+                cout << "Valor invalido. Ingrese un numero entre " << fixed
+                          << setprecision(2) << valorMinimo << " y " << valorMaximo << ".\n";
+            }
+        }
+    }
+
+    /**
+     * @brief Ubica en el arbol activo, si existe, a un estudiante recien agregado al almacen.
+     * @param indice Indice del nuevo estudiante.
+     */
+    void registrarEnArbolActivo(size_t indice) {
+        if (bitmap_.has_value()) {
+            bitmap_->agregarEstudiante(perfiles_, indice);
+        }
+        if (!cubo_.ajustar(perfiles_, indice, 1)) {
+            reconstruirCubo();
+        }
+        if (muestra_.has_value()) {
+            // Se vuelve a muestrear para que el estudiante nuevo tenga la misma probabilidad de entrar.
+            muestra_ = tomarMuestra(perfiles_.cantidad(), muestra_->tamano, muestra_->semilla);
+            if (arbolActual_) {
+                construirArbolActivo();
+            }
+        } else if (arbolActual_) {
+            insertarEnArbol(*arbolActual_, ordenActivo_,
+                            etiquetasClasificacion(perfiles_, ordenActivo_, indice), indice);
+        } else if (arbolPlano_ || arbolEnCubo_ || arbolEnBitmap_) {
+            construirArbolActivo();
+        }
+    }
+
+    /**
+     * @brief Construye el arbol para ordenActivo_ en la representacion vigente y descarta las otras.
+     *
+     * El arbol plano es inmutable, por lo que las altas lo reconstruyen; el de punteros se
+     * actualiza de forma incremental. En modo cubo no se construye ningun arbol: los conteos salen
+     * del cubo si cubre el orden y, si no lo cubre ni aun reconstruido, del indice de bitmaps. En
+     * modo aproximado el arbol es siempre de punteros y se construye solo con la muestra.
+     */
+    void construirArbolActivo() {
+        MEDIR_FASE(FaseMedida::ConstruccionArbol);
+        arbolActual_.reset();
+        arbolPlano_.reset();
+        arbolEnCubo_ = false;
+        arbolEnBitmap_ = false;
+        if (muestra_.has_value()) {
+            arbolActual_ = construirArbolMuestra(perfiles_, ordenActivo_, muestra_->indices);
+            return;
+        }
+        if (representacion_ == RepresentacionArbol::Cubo) {
+            if (!cubo_.cubre(ordenActivo_)) {
+                reconstruirCubo();
+            }
+            arbolEnCubo_ = cubo_.cubre(ordenActivo_);
+            arbolEnBitmap_ = !arbolEnCubo_;
+            if (arbolEnBitmap_) {
+                indiceBitmap();
+            }
+            return;
+        }
+        if (representacion_ == RepresentacionArbol::Punteros) {
+            arbolActual_ = construirArbolClasificacionParalelo(perfiles_, ordenActivo_, pool_);
+        } else {
+            arbolPlano_ = cacheArboles_.obtener(perfiles_, ordenActivo_);
+        }
+    }
+
+    /**
+     * @brief Devuelve el indice de bitmaps, construyendolo si aun no existe.
+     *
+     * Las altas y las notas lo mantienen al dia solo despues de construido, asi que una sesion que
+     * no hace consultas ni usa la representacion cubo nunca paga su construccion.
+     * @return Indice sincronizado con perfiles_.
+     */
+    const IndiceBitmap &indiceBitmap() {
+        if (!bitmap_.has_value()) {
+            bitmap_ = IndiceBitmap::construir(perfiles_, pool_);
+        }
+        return bitmap_.value();
+    }
+
+    /**
+     * @brief Reconstruye el cubo con las dimensiones que caben; en modo cubo incluye el orden activo.
+     */
+    void reconstruirCubo() {
+        const auto requeridas = representacion_ == RepresentacionArbol::Cubo
+                                    ? ordenActivo_
+                                    : vector<VariableClasificacion>{};
+        if (const auto dimensiones = CuboConteos::elegirDimensiones(perfiles_, requeridas);
+            dimensiones.has_value()) {
+            cubo_ = CuboConteos::construir(perfiles_, dimensiones.value(), pool_);
+        } else {
+            cubo_ = CuboConteos();
+        }
+    }
+
+    /**
+     * @brief Ejecuta una accion sobre la raiz del arbol activo, sea cual sea su representacion.
+     * @param accion Funcion generica que recibe una referencia a la raiz de cualquier representacion.
      */
-    static string solicitar(const string &mensaje) {
-        cout << mensaje << ": ";
-        string texto;
-        getline(cin, texto);
-        return recortar(texto);
+    template <typename Accion>
+    void conArbolActivo(Accion &&accion) const {
+        if (arbolEnCubo_) {
+            accion(ReferenciaNodoCubo(&cubo_, ordenActivo_));
+        } else if (arbolEnBitmap_) {
+            accion(ReferenciaNodoBitmap(&bitmap_.value(), &perfiles_, ordenActivo_));
+        } else if (arbolPlano_) {
+            accion(ReferenciaNodoPlano(arbolPlano_.get(), 0U));
+        } else {
+            accion(ReferenciaNodo(arbolActual_.get()));
+        }
     }
 
     /**
-     * @brief Pregunta hasta que el usuario proporcione una respuesta no vacia.
-     * @param mensaje Mensaje mostrado al usuario.
-     * @return Cadena no vacia.
+     * @brief Ejecuta un comando del modo por lotes.
+     * @param linea Comando con sus argumentos.
+     * @throws runtime_error si el comando o sus argumentos no son validos.
      */
-    static string solicitarNoVacio(const string &mensaje) {
-        while (true) {
-            const auto valor = solicitar(mensaje);
-            if (!valor.empty()) {
-                return valor;
+    void ejecutarComando(const string &linea) {
+        const auto espacio = linea.find_first_of(" \t");
+        const auto comando = aMayusculas(linea.substr(0, espacio));
+        const auto argumento = espacio == string::npos ? string() : recortar(linea.substr(espacio));
+        if (comando == "ARBOL") {
+            vector<VariableClasificacion> orden;
+            istringstream nombres(argumento);
+            string nombre;
+            while (getline(nombres, nombre, ',')) {
+                const auto variable = variableDesdeNombre(nombre);
+                if (!variable.has_value()) {
+                    throw runtime_error("Variable desconocida: " + recortar(nombre));
+                }
+                if (find(orden.begin(), orden.end(), variable.value()) != orden.end()) {
+                    throw runtime_error("Variable repetida: " + recortar(nombre));
+                }
+                orden.push_back(variable.value());
             }
-            cout << "El valor no puede estar vacio. Intente nuevamente.\n";
+            if (orden.empty()) {
+                throw runtime_error("Indique al menos una variable");
+            }
+            ordenActivo_ = orden;
+            construirArbolActivo();
+            cout << "Arbol construido correctamente con " << ordenActivo_.size()
+                 << " niveles de clasificacion.\n";
+        } else if (comando == "REPRESENTACION") {
+            const auto nombre = aMayusculas(argumento);
+            if (nombre == "PUNTEROS") {
+                representacion_ = RepresentacionArbol::Punteros;
+            } else if (nombre == "PLANA") {
+                representacion_ = RepresentacionArbol::Plano;
+            } else if (nombre == "CUBO") {
+                representacion_ = RepresentacionArbol::Cubo;
+            } else {
+                throw runtime_error("Representacion desconocida: " + argumento);
+            }
+            if (!ordenActivo_.empty()) {
+                construirArbolActivo();
+            }
+        } else if (comando == "IMPRIMIR") {
+            opcionImprimirArbol();
+        } else if (comando == "HOJAS") {
+            opcionReporteHojas(leerRango(argumento, "Uso: hojas [limite [desde]]"));
+        } else if (comando == "CONSULTA") {
+            responderConsulta(argumento);
+        } else if (comando == "PERFILES") {
+            opcionImprimirPerfiles(leerRango(argumento, "Uso: perfiles [limite [desde]]"));
+        } else if (comando == "IMPORTAR") {
+            const auto separador = argumento.find_first_of(" \t");
+            const auto tipo = aMayusculas(argumento.substr(0, separador));
+            const auto ruta =
+                separador == string::npos ? string() : recortar(argumento.substr(separador));
+            if (ruta.empty() || (tipo != "ESTUDIANTES" && tipo != "HISTORIAL")) {
+                throw runtime_error("Uso: importar estudiantes|historial <archivo.csv>");
+            }
+            importarCsv(tipo == "ESTUDIANTES", ruta);
+        } else if (comando == "GENERAR") {
+            istringstream valores(argumento);
+            ConfiguracionGenerador configuracion;
+            if (!(valores >> configuracion.estudiantes >> configuracion.registros)) {
+                throw runtime_error("Uso: generar <estudiantes> <registros> [semilla]");
+            }
+            valores >> configuracion.semilla;
+            generarDatosSinteticos(repositorioEstudiantes_, repositorioHistorial_, configuracion);
+            recargarPerfiles();
+            cout << "Se generaron " << configuracion.estudiantes << " estudiantes y "
+                 << configuracion.registros << " registros de historial.\n";
+        } else if (comando == "EXPORTAR") {
+            istringstream partes(argumento);
+            string formato;
+            string ruta;
+            string alcance;
+            partes >> formato >> ruta >> alcance;
+            formato = aMayusculas(formato);
+            alcance = aMayusculas(alcance);
+            if ((formato != "CSV" && formato != "JSON") || ruta.empty() ||
+                (!alcance.empty() && alcance != "HOJAS") || !(partes >> ws).eof()) {
+                throw runtime_error("Uso: exportar csv|json <archivo> [hojas]");
+            }
+            exportarArbolActivo(formato == "CSV" ? FormatoExportacion::Csv : FormatoExportacion::Json,
+                                ruta, alcance == "HOJAS");
+        } else if (comando == "MUESTRA") {
+            istringstream valores(argumento);
+            size_t tamano = 0;
+            uint64_t semilla = kSemillaMuestra;
+            if (!(valores >> tamano)) {
+                throw runtime_error("Uso: muestra <tamano> [semilla]");
+            }
+            valores >> semilla;
+            cambiarMuestra(tamano, semilla);
+        } else if (comando == "EXACTA") {
+            imprimirRutaExacta(analizarCondiciones(argumento, perfiles_));
+        } else if (comando == "ESTADISTICAS") {
+            const auto formato = aMayusculas(argumento);
+            if (formato.empty()) {
+                Estadisticas::global().imprimirTabla(cout);
+            } else if (formato == "JSON") {
+                Estadisticas::global().imprimirJson(cout);
+            } else if (formato == "REINICIAR") {
+                Estadisticas::global().reiniciar();
+            } else {
+                throw runtime_error("Uso: estadisticas [json|reiniciar]");
+            }
+        } else if (comando == "COMPACTAR") {
+            repositorioHistorial_.compactar();
+            recargarPerfiles();
+            cout << "Historial compactado: " << repositorioHistorial_.cantidad() << " registros.\n";
+        } else {
+            throw runtime_error("Comando desconocido");
         }
     }
 
     /**
-     * @brief Solicita al usuario un entero dentro de un rango.
-     * @param mensaje Mensaje mostrado al solicitar datos.
-     * @param valorMinimo Valor minimo aceptado.
-     * @param valorMaximo Valor maximo aceptado.
-     * @return Entero valido dentro del rango.
+     * @brief Interpreta los argumentos "[limite [desde]]" de un comando de listado.
+     * @param argumento Texto tras el comando; vacio para el listado completo.
+     * @param uso Mensaje de error si el texto no es valido.
+     * @return Tramo pedido; desde se cuenta a partir de 0.
+     * @throws runtime_error si los valores no son enteros no negativos.
      */
-    static int solicitarEntero(const string &mensaje, int valorMinimo, int valorMaximo) {
-        while (true) {
-            const auto valor = solicitar(mensaje);
-            try {
-                const int numero = stoi(valor);
-                if (numero < valorMinimo || numero > valorMaximo) {
-                    throw out_of_range("Fuera de rango");
-                }
-                return numero;
-            } catch (const exception &) {
-                cout << "Valor invalido. Ingrese un numero entre " << valorMinimo << " y "
-                          << valorMaximo << ".\n";
-            }
+    static RangoListado leerRango(const string &argumento, const char *uso) {
+        RangoListado rango;
+        if (argumento.empty()) {
+            return rango;
+        }
+        istringstream valores(argumento);
+        long long limite = 0;
+        long long desde = 0;
+        string sobrante;
+        // Tras leer el ultimo numero el flujo queda en eof; leer mas lo marcaria como fallido.
+        if (!(valores >> limite) || (!valores.eof() && !(valores >> desde)) ||
+            (valores >> sobrante) || limite < 0 || desde < 0) {
+            throw runtime_error(uso);
         }
+        rango.limite = static_cast<size_t>(limite);
+        rango.desde = static_cast<size_t>(desde);
+        return rango;
     }
 
     /**
-     * @brief Solicita al usuario un valor flotante dentro de un rango.
-     * @param mensaje Mensaje mostrado al solicitar datos.
-     * @param valorMinimo Valor minimo aceptado.
-     * @param valorMaximo Valor maximo aceptado.
-     * @return Numero valido dentro del rango.
+     * @brief Importa un archivo CSV completo con una sola escritura y recarga los perfiles.
+     *
+     * Todas las lineas se validan antes de escribir: si alguna falla no se persiste ningun registro.
+     * @param esEstudiantes true para un CSV de estudiantes; false para uno de historial.
+     * @param ruta Ruta del archivo CSV.
+     * @throws runtime_error si el archivo no existe o contiene registros invalidos.
      */
-    static double solicitarDoble(const string &mensaje, double valorMinimo, double valorMaximo) {
-        while (true) {
-            const auto valor = solicitar(mensaje);
-            try {
-                const double numero = stod(valor);
-                if (numero < valorMinimo || numero > valorMaximo) {
-                    throw out_of_range("Fuera de rango");
+    void importarCsv(bool esEstudiantes, const string &ruta) {
+        if (!fs::exists(ruta)) {
+            throw runtime_error("No existe el archivo " + ruta);
+        }
+        const ArchivoMapeado archivo(ruta);
+        size_t importados = 0;
+        if (esEstudiantes) {
+            const auto estudiantes =
+                analizarCsvParalelo<Estudiante>(archivo.contenido(), kColumnasCsvEstudiantes, pool_,
+                                                estudianteDesdeCsv);
+            repositorioEstudiantes_.agregarLote(estudiantes);
+            repositorioEstudiantes_.confirmar();
+            importados = estudiantes.size();
+        } else {
+            const auto registros =
+                analizarCsvParalelo<RegistroHistorial>(archivo.contenido(), kColumnasCsvHistorial,
+                                                       pool_, registroDesdeCsv);
+            for (const auto &registro : registros) {
+                if (!repositorioEstudiantes_.existe(registro.carneEstudiante)) {
+                    throw runtime_error("No existe un estudiante con carne " + registro.carneEstudiante);
                 }
-                return numero;
-            } catch (const exception &) {
-                cout << "Valor invalido. Ingrese un numero entre " << fixed
-                          << setprecision(2) << valorMinimo << " y " << valorMaximo << ".\n";
             }
+            repositorioHistorial_.agregarLote(registros);
+            repositorioHistorial_.confirmar();
+            importados = registros.size();
+        }
+        recargarPerfiles();
+        cout << "Se importaron " << importados
+             << (esEstudiantes ? " estudiantes.\n" : " registros de historial.\n");
+    }
+
+    /**
+     * @brief Vuelve a cargar los perfiles desde disco y rehace las estructuras que dependen de ellos.
+     */
+    void recargarPerfiles() {
+        perfiles_ = cargarPerfiles(repositorioEstudiantes_, repositorioHistorial_, pool_, modoCarga_);
+        cacheArboles_.invalidar();
+        reconstruirCubo();
+        bitmap_.reset();
+        if (muestra_.has_value()) {
+            muestra_ = tomarMuestra(perfiles_.cantidad(), muestra_->tamano, muestra_->semilla);
+        }
+        if (arbolActual_ || arbolPlano_ || arbolEnCubo_ || arbolEnBitmap_) {
+            construirArbolActivo();
         }
     }
 
     /**
-     * @brief Recarga los perfiles desde el almacenamiento y reconstruye el arbol activo si es necesario.
+     * @brief Pasa a la siguiente representacion (punteros, plana, cubo) y reconstruye el arbol activo.
      */
-    void actualizarPerfiles() {
-        perfiles_ = cargarPerfiles(repositorioEstudiantes_, repositorioHistorial_);
+    void opcionCambiarRepresentacion() {
+        switch (representacion_) {
+            case RepresentacionArbol::Punteros:
+                representacion_ = RepresentacionArbol::Plano;
+                break;
+            case RepresentacionArbol::Plano:
+                representacion_ = RepresentacionArbol::Cubo;
+                break;
+            default:
+                representacion_ = RepresentacionArbol::Punteros;
+                break;
+        }
         if (!ordenActivo_.empty()) {
-            arbolActual_ = construirArbolClasificacion(perfiles_, ordenActivo_);
+            construirArbolActivo();
         }
+        cout << "Representacion del arbol: " << representacionComoCadena(representacion_) << ".\n";
     }
 
     /**
      * @brief Construye un nuevo arbol de clasificacion segun las variables seleccionadas por el usuario.
      */
     void opcionConstruirArbol() {
-        if (perfiles_.empty()) {
+        if (perfiles_.vacio()) {
             cout << "No hay estudiantes registrados. Registre estudiantes antes de "
                          "construir el arbol.\n";
             return;
@@ -945,7 +6910,7 @@ private:
             return;
         }
         ordenActivo_ = orden;
-        arbolActual_ = construirArbolClasificacion(perfiles_, ordenActivo_);
+        construirArbolActivo();
         cout << "Arbol construido correctamente con " << ordenActivo_.size()
                   << " niveles de clasificacion.\n";
     }
@@ -1041,15 +7006,23 @@ private:
         if (!arbolListo()) {
             return;
         }
-        imprimirArbolPorNiveles(*arbolActual_);
+        if (muestra_.has_value()) {
+            imprimirArbolAproximado(ReferenciaNodo(arbolActual_.get()), muestra_.value());
+            return;
+        }
+        conArbolActivo([](auto raiz) { imprimirArbolPorNiveles(raiz); });
     }
 
     /**
      * @brief Valida que se haya construido un arbol de clasificacion.
      * @return true cuando el arbol existe; false en caso contrario (se imprime una guia).
+     * @throws runtime_error en modo por lotes si no hay arbol, para que el comando cuente como fallido.
      */
     bool arbolListo() {
-        if (!arbolActual_) {
+        if (!arbolActual_ && !arbolPlano_ && !arbolEnCubo_ && !arbolEnBitmap_) {
+            if (enLote_) {
+                throw runtime_error("Aun no se ha construido un arbol; use 'arbol Variable1,...' antes");
+            }
             cout << "Aun no se ha construido un arbol. Seleccione la opcion 1 primero.\n";
             return false;
         }
@@ -1063,18 +7036,28 @@ private:
         if (!arbolListo()) {
             return;
         }
-        auto *nodo = arbolActual_.get();
-        NodoArbolClasificacion *padre = nullptr;
+        conArbolActivo([this](auto raiz) { porcentajesCondicionados(raiz); });
+    }
+
+    /**
+     * @brief Navega desde la raiz indicada e imprime los porcentajes del nodo elegido.
+     * @param raiz Raiz del arbol activo.
+     */
+    template <typename Referencia>
+    void porcentajesCondicionados(Referencia raiz) {
+        auto nodo = raiz;
+        Referencia padre;
+        vector<CondicionClasificacion> condiciones;
         for (size_t nivel = 0; nivel < ordenActivo_.size(); ++nivel) {
-            if (nodo->hijos.empty()) {
+            if (nodo.cantidadHijos() == 0) {
                 break;
             }
             const auto variable = ordenActivo_[nivel];
             cout << "\n" << variableComoCadena(variable) << " disponibles:\n";
-            for (size_t indice = 0; indice < nodo->hijos.size(); ++indice) {
-                const auto &hijo = nodo->hijos[indice];
-                cout << " " << (indice + 1) << ". " << hijo->etiqueta << " ("
-                          << hijo->indicesEstudiantes.size() << ")\n";
+            for (size_t indice = 0; indice < nodo.cantidadHijos(); ++indice) {
+                const auto hijo = nodo.hijo(indice);
+                cout << " " << (indice + 1) << ". " << hijo.etiqueta() << " ("
+                          << hijo.cantidadEstudiantes() << ")\n";
             }
             cout
                 << "Seleccione una opcion numerica o presione Enter para terminar en este nivel: ";
@@ -1086,36 +7069,57 @@ private:
             }
             try {
                 const int opcion = stoi(entrada);
-                if (opcion < 1 || opcion > static_cast<int>(nodo->hijos.size())) {
+                if (opcion < 1 || opcion > static_cast<int>(nodo.cantidadHijos())) {
                     throw out_of_range("rango");
                 }
                 padre = nodo;
-                nodo = nodo->hijos[opcion - 1].get();
+                nodo = nodo.hijo(static_cast<size_t>(opcion - 1));
+                condiciones.push_back({variable, codigoDeEtiqueta(variable, nodo.etiqueta())});
             } catch (const exception &) {
                 cout << "Seleccion invalida. Operacion cancelada.\n";
                 return;
             }
         }
 
-        const auto total = static_cast<double>(arbolActual_->indicesEstudiantes.size());
+        const auto total = static_cast<double>(raiz.cantidadEstudiantes());
         if (total == 0.0) {
             cout << "No hay estudiantes registrados.\n";
             return;
         }
-        const auto cantidadNodo = static_cast<double>(nodo->indicesEstudiantes.size());
+        const auto cantidadNodo = static_cast<double>(nodo.cantidadEstudiantes());
         const auto porcentajeTotal = (cantidadNodo / total) * 100.0;
         cout << "\nRuta seleccionada:\n";
         const auto ruta = rutaHastaRaiz(nodo);
         for (size_t i = 1; i < ruta.size(); ++i) {
-            const auto *actual = ruta[i];
-            const auto nombreVariable = variableComoCadena(actual->variable.value());
-            cout << " - " << nombreVariable << ": " << actual->etiqueta << '\n';
+            const auto &actual = ruta[i];
+            const auto nombreVariable = variableComoCadena(actual.variable().value());
+            cout << " - " << nombreVariable << ": " << actual.etiqueta() << '\n';
+        }
+        if (muestra_.has_value()) {
+            {
+                SalidaBufer salida(cout);
+                const auto fraccion = muestra_->fraccion();
+                const auto base = padre.valida() ? padre.cantidadEstudiantes()
+                                                 : nodo.cantidadEstudiantes();
+                salida << "\nPorcentaje respecto al total (estimado): ";
+                escribirIntervalo(salida, intervaloProporcion(nodo.cantidadEstudiantes(),
+                                                              raiz.cantidadEstudiantes(), fraccion));
+                salida << "\nPorcentaje condicionado al nivel anterior (estimado): ";
+                escribirIntervalo(salida,
+                                  intervaloProporcion(nodo.cantidadEstudiantes(), base, fraccion));
+                salida << '\n';
+            }
+            const auto exacta = aMayusculas(solicitar("Recalcular esta ruta de forma exacta (Si/No)"));
+            if (exacta == "SI" || exacta == "S") {
+                imprimirRutaExacta(condiciones);
+            }
+            return;
         }
         cout << fixed << setprecision(2);
         cout << "\nPorcentaje respecto al total: " << porcentajeTotal << "%\n";
-        if (padre != nullptr) {
+        if (padre.valida()) {
             const auto porcentajeCondicionado =
-                (cantidadNodo / static_cast<double>(padre->indicesEstudiantes.size())) * 100.0;
+                (cantidadNodo / static_cast<double>(padre.cantidadEstudiantes())) * 100.0;
             cout << "Porcentaje condicionado al nivel anterior: " << porcentajeCondicionado << "%\n";
         } else {
             cout << "Porcentaje condicionado al nivel anterior: 100%\n";
@@ -1123,51 +7127,306 @@ private:
     }
 
     /**
-     * @brief Imprime totales y porcentajes para cada nodo hoja.
+     * @brief Busca el codigo de una categoria a partir de su etiqueta.
+     * @param variable Variable de la categoria.
+     * @param etiqueta Etiqueta exacta de la categoria.
+     * @return Codigo de la categoria.
+     * @throws runtime_error si la variable no tiene esa categoria.
+     */
+    uint16_t codigoDeEtiqueta(VariableClasificacion variable, const string &etiqueta) const {
+        for (uint16_t codigo = 0; codigo < perfiles_.cantidadCategorias(variable); ++codigo) {
+            if (perfiles_.etiqueta(variable, codigo) == etiqueta) {
+                return codigo;
+            }
+        }
+        throw runtime_error("Categoria desconocida: " + etiqueta);
+    }
+
+    /**
+     * @brief Calcula sobre todos los perfiles, con el indice de bitmaps, los conteos de una ruta.
+     *
+     * Una sola evaluacion P(ultimo nivel | niveles anteriores) da el conteo del nodo y el de su
+     * padre, sin construir el arbol completo.
+     * @param ruta Condiciones desde el primer nivel hasta el nodo elegido.
+     */
+    void imprimirRutaExacta(const vector<CondicionClasificacion> &ruta) {
+        const auto &indice = indiceBitmap();
+        const auto poblacion = indice.cantidad();
+        if (poblacion == 0) {
+            cout << "No hay estudiantes registrados.\n";
+            return;
+        }
+        ResultadoConsulta resultado{poblacion, poblacion};
+        if (!ruta.empty()) {
+            ConsultaProbabilidad consulta;
+            consulta.objetivo.push_back(ruta.back());
+            consulta.evidencia.assign(ruta.begin(), ruta.end() - 1);
+            resultado = evaluarConsulta(consulta, indice);
+        }
+        const auto porcentaje = [](size_t parte, size_t todo) {
+            return DecimalFijo{
+                todo == 0 ? 0.0 : static_cast<double>(parte) / static_cast<double>(todo) * 100.0, 2};
+        };
+        SalidaBufer salida(cout);
+        salida << "\nRuta exacta:\n";
+        for (const auto &condicion : ruta) {
+            salida << " - " << variableComoCadena(condicion.variable) << ": "
+                   << perfiles_.etiqueta(condicion.variable, condicion.codigo) << '\n';
+        }
+        salida << "Estudiantes: " << resultado.favorables << " de " << poblacion
+               << "\nPorcentaje respecto al total: " << porcentaje(resultado.favorables, poblacion)
+               << "%\nPorcentaje condicionado al nivel anterior: "
+               << porcentaje(resultado.favorables, resultado.casos) << "%\n";
+    }
+
+    /**
+     * @brief Solicita el tamano de la muestra del modo aproximado.
+     */
+    void opcionModoAproximado() {
+        const auto tamano = solicitarEntero("Tamano de la muestra (0 para el modo exacto)", 0,
+                                            numeric_limits<int>::max());
+        cambiarMuestra(static_cast<size_t>(tamano), kSemillaMuestra);
+    }
+
+    /**
+     * @brief Activa el modo aproximado con una muestra nueva o, con tamano 0, vuelve al exacto.
+     *
+     * En modo aproximado el arbol, el reporte por hojas, la navegacion y las consultas usan solo la
+     * muestra e informan intervalos de confianza; una ruta puede recalcularse de forma exacta.
+     * @param tamano Estudiantes de la muestra; 0 desactiva el modo aproximado.
+     * @param semilla Semilla del muestreo.
+     */
+    void cambiarMuestra(size_t tamano, uint64_t semilla) {
+        if (tamano == 0) {
+            muestra_.reset();
+        } else {
+            muestra_ = tomarMuestra(perfiles_.cantidad(), tamano, semilla);
+        }
+        if (arbolActual_ || arbolPlano_ || arbolEnCubo_ || arbolEnBitmap_) {
+            construirArbolActivo();
+        }
+        if (muestra_.has_value()) {
+            cout << "Modo aproximado: muestra de " << muestra_->indices.size() << " de "
+                 << muestra_->poblacion << " estudiantes.\n";
+        } else {
+            cout << "Modo exacto activado.\n";
+        }
+    }
+
+    /**
+     * @brief Solicita una consulta P(A=x | B=y, ...) y muestra su resultado.
+     */
+    void opcionConsultarProbabilidad() {
+        cout << "Ejemplo: P(Trabaja=Si | Genero=Femenino, RangoEdad=18-30)\n";
+        cout << "Las categorias con ',', '|' o '=' van entre comillas: P(ColegioProcedencia=\"A, B\")\n";
+        responderConsulta(solicitar("Consulta"));
+    }
+
+    /**
+     * @brief Evalua una consulta escrita contra los perfiles cargados e imprime la probabilidad.
+     * @param texto Consulta con la forma P(A=x | B=y, ...).
+     * @throws runtime_error en modo por lotes si la consulta no es valida; en el menu se informa.
+     */
+    void responderConsulta(const string &texto) {
+        try {
+            const auto consulta = analizarConsulta(texto, perfiles_);
+            if (muestra_.has_value()) {
+                const auto resultado = evaluarConsultaMuestra(consulta, perfiles_, muestra_->indices);
+                if (resultado.casos == 0) {
+                    cout << "Ningun estudiante de la muestra cumple la condicion.\n";
+                    return;
+                }
+                SalidaBufer salida(cout);
+                salida << recortar(texto) << " ~ ";
+                escribirIntervalo(salida, intervaloProporcion(resultado.favorables, resultado.casos,
+                                                              muestra_->fraccion()));
+                salida << " (" << resultado.favorables << " de " << resultado.casos
+                       << " casos de la muestra)\n";
+                return;
+            }
+            const auto resultado = evaluarConsulta(consulta, indiceBitmap());
+            if (resultado.casos == 0) {
+                cout << "Ningun estudiante cumple la condicion; la probabilidad no esta definida.\n";
+                return;
+            }
+            const auto probabilidad = static_cast<double>(resultado.favorables) /
+                                      static_cast<double>(resultado.casos) * 100.0;
+            cout << fixed << setprecision(2) << recortar(texto) << " = " << probabilidad << "% ("
+                 << resultado.favorables << " de " << resultado.casos << " estudiantes)\n";
+        } catch (const exception &ex) {
+            if (enLote_) {
+                throw;
+            }
+            cout << "Consulta invalida: " << ex.what() << '\n';
+        }
+    }
+
+    /**
+     * @brief Solicita formato y archivo y exporta el arbol actual.
      */
-    void opcionReporteHojas() {
+    void opcionExportarArbol() {
         if (!arbolListo()) {
             return;
         }
-        vector<const NodoArbolClasificacion *> hojas;
-        recolectarHojas(*arbolActual_, hojas);
-        if (hojas.empty()) {
-            cout << "El arbol no tiene hojas.\n";
+        const auto formato = aMayusculas(solicitarNoVacio("Formato (CSV/JSON)"));
+        if (formato != "CSV" && formato != "JSON") {
+            cout << "Formato no valido. Operacion cancelada.\n";
             return;
         }
-        const auto total = static_cast<double>(arbolActual_->indicesEstudiantes.size());
-        cout << "\nReporte por hojas:\n";
-        cout << fixed << setprecision(2);
-        for (const auto *hoja : hojas) {
-            const auto ruta = rutaHastaRaiz(hoja);
-            ostringstream recorrido;
+        const auto ruta = solicitarNoVacio("Archivo de destino");
+        const auto soloHojas = aMayusculas(solicitarNoVacio("Solo hojas (Si/No)"));
+        try {
+            exportarArbolActivo(formato == "CSV" ? FormatoExportacion::Csv : FormatoExportacion::Json,
+                                ruta, soloHojas == "SI" || soloHojas == "S");
+        } catch (const exception &ex) {
+            cout << "No se pudo exportar el arbol: " << ex.what() << '\n';
+        }
+    }
+
+    /**
+     * @brief Escribe el arbol activo en un archivo con exportarArbol.
+     * @param formato CSV o JSON.
+     * @param ruta Archivo de destino; se reemplaza si existe.
+     * @param soloHojas true para exportar solo las hojas.
+     * @throws runtime_error si el archivo no se puede crear o escribir.
+     */
+    void exportarArbolActivo(FormatoExportacion formato, const string &ruta, bool soloHojas) {
+        if (!arbolListo()) {
+            return;
+        }
+        if (muestra_.has_value()) {
+            throw runtime_error("la exportacion usa conteos exactos; desactive el modo aproximado");
+        }
+        MEDIR_FASE(FaseMedida::FormatoSalida);
+        ofstream archivo(ruta, ios::binary | ios::trunc);
+        if (!archivo) {
+            throw runtime_error("No se pudo crear " + ruta);
+        }
+        size_t filas = 0;
+        {
+            SalidaBufer salida(archivo);
+            conArbolActivo(
+                [&](auto raiz) { filas = exportarArbol(raiz, formato, soloHojas, salida); });
+        }
+        archivo.close();
+        if (!archivo) {
+            throw runtime_error("No se pudo escribir " + ruta);
+        }
+        cout << "Se exportaron " << filas << (soloHojas ? " hojas" : " nodos") << " a " << ruta
+             << ".\n";
+    }
+
+    /**
+     * @brief Imprime totales y porcentajes para cada nodo hoja.
+     * @param rango Tramo de hojas a mostrar, en el orden del recorrido.
+     */
+    void opcionReporteHojas(const RangoListado &rango = {}) {
+        if (!arbolListo()) {
+            return;
+        }
+        MEDIR_FASE(FaseMedida::FormatoSalida);
+        const auto *muestra = muestra_.has_value() ? &muestra_.value() : nullptr;
+        conArbolActivo([&](auto raiz) { reporteHojas(raiz, rango, muestra); });
+    }
+
+    /**
+     * @brief Imprime la ruta, el total y el porcentaje de cada hoja bajo la raiz indicada.
+     *
+     * Las hojas salen de un recorrido en profundidad; la ruta de cada una se lee de la pila del
+     * recorrido en lugar de subir por los padres.
+     * @param raiz Raiz del arbol activo.
+     * @param rango Tramo de hojas a mostrar.
+     * @param muestra Muestra del arbol en modo aproximado; nullptr si el arbol es exacto.
+     */
+    template <typename Referencia>
+    static void reporteHojas(Referencia raiz, const RangoListado &rango,
+                             const MuestraPerfiles *muestra) {
+        SalidaBufer salida(cout);
+        const auto total = static_cast<double>(raiz.cantidadEstudiantes());
+        size_t hojas = 0;
+        salida << "\nReporte por hojas:\n";
+        if (muestra != nullptr) {
+            salida << "(Estimado con una muestra de " << muestra->indices.size() << " de "
+                   << muestra->poblacion << " estudiantes; intervalos del 95%)\n";
+        }
+        recorrerEnProfundidad(raiz, [&](const vector<Referencia> &ruta) {
+            const auto &hoja = ruta.back();
+            if (hoja.cantidadHijos() != 0) {
+                return;
+            }
+            const auto posicion = hojas++;
+            if (posicion < rango.desde || posicion - rango.desde >= rango.limite) {
+                return;
+            }
+            salida << " - ";
             for (size_t i = 1; i < ruta.size(); ++i) {
-                const auto *nodo = ruta[i];
-                const auto nombreVariable = variableComoCadena(nodo->variable.value());
-                recorrido << nombreVariable << "=" << nodo->etiqueta;
+                const auto &nodo = ruta[i];
+                salida << variableComoCadena(nodo.variable().value()) << "=" << nodo.etiqueta();
                 if (i + 1 < ruta.size()) {
-                    recorrido << " -> ";
+                    salida << " -> ";
                 }
             }
-            const auto porcentaje = (hoja->indicesEstudiantes.size() / total) * 100.0;
-            cout << " - " << recorrido.str() << " | Total: " << hoja->indicesEstudiantes.size()
-                      << " | %: " << porcentaje << '\n';
-        }
+            if (muestra != nullptr) {
+                const auto intervalo = intervaloProporcion(
+                    hoja.cantidadEstudiantes(), raiz.cantidadEstudiantes(), muestra->fraccion());
+                salida << " | Total: ~"
+                       << llround(intervalo.estimado * static_cast<double>(muestra->poblacion))
+                       << " | %: ";
+                escribirIntervalo(salida, intervalo);
+                salida << '\n';
+                return;
+            }
+            const auto porcentaje = (hoja.cantidadEstudiantes() / total) * 100.0;
+            salida << " | Total: " << hoja.cantidadEstudiantes()
+                   << " | %: " << DecimalFijo{porcentaje, 2} << '\n';
+        });
+        const auto [inicio, fin] = rango.acotar(hojas);
+        imprimirPieRango(salida, inicio, fin, hojas);
     }
 
     /**
      * @brief Imprime cada perfil de estudiante incluyendo los datos de historial.
+     *
+     * Con solo agregados en memoria y un historial sin compactar, leer cada historial del disco
+     * recorreria el archivo una vez por estudiante; el listado lo recorre entonces una sola vez y
+     * guarda solo el numero de los registros del tramo pedido.
+     * @param rango Tramo de estudiantes a mostrar, en el orden del archivo.
      */
-    void opcionImprimirPerfiles() const {
-        if (perfiles_.empty()) {
+    void opcionImprimirPerfiles(const RangoListado &rango = {}) {
+        if (perfiles_.vacio()) {
             cout << "No hay estudiantes almacenados.\n";
             return;
         }
-        for (const auto &perfil : perfiles_) {
-            cout << "\n----------------------------------------\n";
-            imprimirPerfil(perfil);
+        MEDIR_FASE(FaseMedida::FormatoSalida);
+        SalidaBufer salida(cout);
+        const auto [inicio, fin] = rango.acotar(perfiles_.cantidad());
+        const auto imprimir = [&](size_t indice, auto &&recorrerDisco) {
+            salida << "\n----------------------------------------\n";
+            imprimirPerfil(salida, perfiles_, indice, recorrerDisco);
+        };
+        if (perfiles_.historialEnMemoria() || repositorioHistorial_.ordenadoPorCarne()) {
+            for (auto indice = inicio; indice < fin; ++indice) {
+                imprimir(indice, [&](auto &&visitar) {
+                    repositorioHistorial_.recorrerCarne(perfiles_.carne(indice), visitar);
+                });
+            }
+        } else {
+            vector<string_view> carnes;
+            carnes.reserve(fin - inicio);
+            for (auto indice = inicio; indice < fin; ++indice) {
+                carnes.push_back(perfiles_.carne(indice));
+            }
+            repositorioHistorial_.recorrerPorCarnes(
+                carnes, [&](size_t posicion, span<const VistaRegistroHistorial> vistas) {
+                    imprimir(inicio + posicion, [&](auto &&visitar) {
+                        for (const auto &vista : vistas) {
+                            visitar(vista);
+                        }
+                    });
+                });
         }
-        cout << "\n";
+        salida << "\n";
+        imprimirPieRango(salida, inicio, fin, perfiles_.cantidad());
     }
 
     /**
@@ -1194,7 +7453,9 @@ private:
 
         try {
             repositorioEstudiantes_.agregar(estudiante);
-            actualizarPerfiles();
+            repositorioEstudiantes_.confirmar();
+            cacheArboles_.invalidar();
+            registrarEnArbolActivo(perfiles_.agregarEstudiante(estudiante));
             cout << "Estudiante registrado correctamente.\n";
         } catch (const exception &ex) {
             cout << "No se pudo registrar el estudiante: " << ex.what() << '\n';
@@ -1218,7 +7479,33 @@ private:
         registro.nota = solicitarDoble("Nota (0-100)", 0.0, 100.0);
         try {
             repositorioHistorial_.agregar(registro);
-            actualizarPerfiles();
+            repositorioHistorial_.confirmar();
+            const auto indice = perfiles_.buscarIndice(registro.carneEstudiante);
+            // En modo aproximado el arbol solo contiene a los estudiantes de la muestra.
+            const auto enArbol =
+                arbolActual_ && indice.has_value() &&
+                (!muestra_.has_value() ||
+                 binary_search(muestra_->indices.begin(), muestra_->indices.end(), indice.value()));
+            vector<string> etiquetasAnteriores;
+            if (enArbol) {
+                etiquetasAnteriores = etiquetasClasificacion(perfiles_, ordenActivo_, indice.value());
+            }
+            const auto retirado = indice.has_value() && cubo_.ajustar(perfiles_, indice.value(), -1);
+            perfiles_.agregarRegistro(registro);
+            cacheArboles_.invalidar();
+            if (indice.has_value() && bitmap_.has_value()) {
+                bitmap_->actualizarEstudiante(perfiles_, indice.value());
+            }
+            if (!retirado || !cubo_.ajustar(perfiles_, indice.value(), 1)) {
+                reconstruirCubo();
+            }
+            if (enArbol) {
+                reubicarEnArbol(*arbolActual_, ordenActivo_, etiquetasAnteriores,
+                                etiquetasClasificacion(perfiles_, ordenActivo_, indice.value()),
+                                indice.value());
+            } else if (!arbolActual_ && (arbolPlano_ || arbolEnCubo_ || arbolEnBitmap_)) {
+                construirArbolActivo();
+            }
             cout << "Nota registrada correctamente.\n";
         } catch (const exception &ex) {
             cout << "No se pudo registrar la nota: " << ex.what() << '\n';
@@ -1226,16 +7513,321 @@ private:
     }
 };
 
+#ifdef MODO_BENCHMARK
 /**
- * @brief Punto de entrada del programa.
+ * @brief Bufer de salida que descarta lo escrito; silencia los reportes mientras se miden.
  */
-int main() {
-    try {
+class SalidaNula : public streambuf {
+protected:
+    int overflow(int caracter) override {
+        return traits_type::not_eof(caracter);
+    }
+
+    streamsize xsputn(const char *, streamsize cantidad) override {
+        return cantidad;
+    }
+};
+
+/**
+ * @brief Ejecuta una operacion varias veces y devuelve el menor tiempo observado.
+ * @param repeticiones Cantidad de ejecuciones (al menos una).
+ * @param operacion Funcion sin argumentos que se mide.
+ * @return Segundos de la ejecucion mas rapida.
+ */
+template <typename Operacion>
+double medirSegundos(size_t repeticiones, Operacion &&operacion) {
+    auto mejor = numeric_limits<double>::infinity();
+    for (size_t repeticion = 0; repeticion < max<size_t>(repeticiones, 1U); ++repeticion) {
+        const auto inicio = chrono::steady_clock::now();
+        operacion();
+        const chrono::duration<double> duracion = chrono::steady_clock::now() - inicio;
+        mejor = min(mejor, duracion.count());
+    }
+    return mejor;
+}
+
+/**
+ * @brief Escribe una medicion en la salida estandar como una linea JSON.
+ * @param estudiantes Estudiantes del conjunto de datos.
+ * @param registros Registros de historial del conjunto de datos.
+ * @param hilos Hilos del pool usado.
+ * @param operacion Nombre de la operacion medida.
+ * @param detalle Orden de variables u otro dato de la operacion; vacio si no aplica.
+ * @param segundos Tiempo medido.
+ */
+void emitirMedicion(size_t estudiantes, size_t registros, size_t hilos, const string &operacion,
+                    const string &detalle, double segundos) {
+    cout << "{\"estudiantes\":" << estudiantes << ",\"registros\":" << registros
+         << ",\"hilos\":" << hilos << ",\"operacion\":\"" << operacion << "\",\"detalle\":\""
+         << detalle << "\",\"segundos\":" << setprecision(6) << fixed << segundos << "}\n";
+    cout.flush();
+}
+
+/**
+ * @brief Genera conjuntos sinteticos de varios tamanos y mide carga, construccion de arboles,
+ *        recoleccion de hojas y reportes; cada medicion se emite como una linea JSON.
+ * @param argumentos Opciones --tamanos N1,N2,..., --registros-por-estudiante K, --repeticiones R,
+ *        --semilla S, --directorio D y --conservar.
+ * @return 0 si todas las mediciones terminaron; 2 si las opciones no son validas.
+ * @throws runtime_error si falla la generacion o la lectura de los datos.
+ */
+int ejecutarBenchmark(const vector<string> &argumentos) {
+    vector<size_t> tamanos = {1'000, 10'000, 100'000, 1'000'000, 10'000'000};
+    size_t registrosPorEstudiante = 4;
+    size_t repeticiones = 3;
+    uint64_t semilla = 42;
+    auto directorio = fs::temp_directory_path() / "proyecto_estructuras_benchmark";
+    bool conservar = false;
+    for (size_t i = 0; i < argumentos.size(); ++i) {
+        const auto &opcion = argumentos[i];
+        const auto siguiente = [&]() -> const string & {
+            if (i + 1 >= argumentos.size()) {
+                throw runtime_error("Falta el valor de " + opcion);
+            }
+            return argumentos[++i];
+        };
+        if (opcion == "--tamanos") {
+            tamanos.clear();
+            istringstream lista(siguiente());
+            string valor;
+            while (getline(lista, valor, ',')) {
+                size_t tamano = 0;
+                if (!convertirNumero(valor, tamano) || tamano == 0) {
+                    throw runtime_error("Tamano invalido: " + valor);
+                }
+                tamanos.push_back(tamano);
+            }
+        } else if (opcion == "--registros-por-estudiante") {
+            if (!convertirNumero(siguiente(), registrosPorEstudiante)) {
+                throw runtime_error("Cantidad de registros invalida");
+            }
+        } else if (opcion == "--repeticiones") {
+            if (!convertirNumero(siguiente(), repeticiones) || repeticiones == 0) {
+                throw runtime_error("Cantidad de repeticiones invalida");
+            }
+        } else if (opcion == "--semilla") {
+            if (!convertirNumero(siguiente(), semilla)) {
+                throw runtime_error("Semilla invalida");
+            }
+        } else if (opcion == "--directorio") {
+            directorio = siguiente();
+        } else if (opcion == "--conservar") {
+            conservar = true;
+        } else {
+            cerr << "Uso: Proyecto_Estructuras_2_benchmark [--tamanos N1,N2,...]\n"
+                 << "       [--registros-por-estudiante K] [--repeticiones R] [--semilla S]\n"
+                 << "       [--directorio D] [--conservar]\n";
+            return 2;
+        }
+    }
+
+    const vector<vector<VariableClasificacion>> ordenes = {
+        {VariableClasificacion::Genero, VariableClasificacion::TipoColegio},
+        {VariableClasificacion::Residencia, VariableClasificacion::RangoEdad,
+         VariableClasificacion::RangoPromedio},
+        {VariableClasificacion::ColegioProcedencia, VariableClasificacion::EstadoCivil,
+         VariableClasificacion::Trabaja, VariableClasificacion::RangoAprobacion}};
+    const auto directorioOriginal = fs::current_path();
+    for (const auto estudiantes : tamanos) {
+        const auto registros = estudiantes * registrosPorEstudiante;
+        const auto carpeta = directorio / ("n" + to_string(estudiantes));
+        fs::remove_all(carpeta);
+        fs::create_directories(carpeta);
+        fs::current_path(carpeta);
+        cerr << "Midiendo " << estudiantes << " estudiantes y " << registros << " registros...\n";
+
+        PoolTrabajo pool;
+        const auto medir = [&](const string &operacion, const string &detalle, size_t veces,
+                               auto &&operacionMedida) {
+            emitirMedicion(estudiantes, registros, pool.hilos(), operacion, detalle,
+                           medirSegundos(veces, operacionMedida));
+        };
+        {
+            RepositorioEstudiantes repositorioEstudiantes(kArchivoEstudiantes);
+            RepositorioHistorial repositorioHistorial(kArchivoHistorial);
+            medir("generarDatosSinteticos", "", 1, [&] {
+                generarDatosSinteticos(repositorioEstudiantes, repositorioHistorial,
+                                       {estudiantes, registros, semilla});
+            });
+        }
+
+        const RepositorioEstudiantes repositorioEstudiantes(kArchivoEstudiantes);
+        const RepositorioHistorial repositorioHistorial(kArchivoHistorial);
+        medir("cargarTodos", "estudiantes", repeticiones,
+              [&] { (void)repositorioEstudiantes.cargarTodos(&pool); });
+        medir("cargarTodos", "historial", repeticiones,
+              [&] { (void)repositorioHistorial.cargarTodos(&pool); });
+        AlmacenPerfiles perfiles;
+        medir("cargarPerfiles", "completa", repeticiones, [&] {
+            perfiles = cargarPerfiles(repositorioEstudiantes, repositorioHistorial, pool);
+        });
+        medir("cargarPerfiles", "soloAgregados", repeticiones, [&] {
+            (void)cargarPerfiles(repositorioEstudiantes, repositorioHistorial, pool,
+                                 ModoCargaPerfiles::SoloAgregados);
+        });
+
+        for (const auto &orden : ordenes) {
+            string nombres;
+            for (const auto variable : orden) {
+                nombres += (nombres.empty() ? "" : ",") + variableComoIdentificador(variable);
+            }
+            unique_ptr<NodoArbolClasificacion> raiz;
+            medir("construirArbolClasificacion", nombres, repeticiones,
+                  [&] { raiz = construirArbolClasificacion(perfiles, orden); });
+            medir("construirArbolClasificacionParalelo", nombres, repeticiones,
+                  [&] { (void)construirArbolClasificacionParalelo(perfiles, orden, pool); });
+            medir("ArbolPlano::construir", nombres, repeticiones,
+                  [&] { (void)ArbolPlano::construir(perfiles, orden); });
+            medir("recolectarHojas", nombres, repeticiones, [&] {
+                vector<ReferenciaNodo> hojas;
+                recolectarHojas(ReferenciaNodo(raiz.get()), hojas);
+            });
+        }
+        perfiles = AlmacenPerfiles();
+
         Aplicacion app;
-        app.ejecutar();
+        SalidaNula salidaNula;
+        for (const auto &orden : ordenes) {
+            string nombres;
+            for (const auto variable : orden) {
+                nombres += (nombres.empty() ? "" : ",") + variableComoIdentificador(variable);
+            }
+            auto *salidaOriginal = cout.rdbuf(&salidaNula);
+            istringstream construir("arbol " + nombres);
+            app.ejecutarLote(construir);
+            const auto imprimir = medirSegundos(repeticiones, [&] {
+                istringstream comando("imprimir");
+                app.ejecutarLote(comando);
+            });
+            const auto hojas = medirSegundos(repeticiones, [&] {
+                istringstream comando("hojas");
+                app.ejecutarLote(comando);
+            });
+            cout.rdbuf(salidaOriginal);
+            emitirMedicion(estudiantes, registros, pool.hilos(), "reporteNiveles", nombres, imprimir);
+            emitirMedicion(estudiantes, registros, pool.hilos(), "reporteHojas", nombres, hojas);
+        }
+
+        fs::current_path(directorioOriginal);
+        if (!conservar) {
+            fs::remove_all(carpeta);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Punto de entrada del ejecutable de benchmark.
+ * @param argc Cantidad de argumentos.
+ * @param argv Opciones de ejecutarBenchmark.
+ * @return Codigo de salida del proceso.
+ */
+int main(int argc, char *argv[]) {
+    try {
+        return ejecutarBenchmark(vector<string>(argv + 1, argv + argc));
     } catch (const exception &ex) {
         cerr << "Error critico: " << ex.what() << '\n';
         return 1;
     }
-    return 0;
 }
+#else
+/**
+ * @brief Abre la aplicacion y ejecuta el menu o los comandos indicados.
+ * @param argumentos Argumentos sin las opciones globales.
+ * @param modoCarga Cuanto historial se conserva en memoria.
+ * @param sincronizacion Cuando se llevan a disco las escrituras de los repositorios.
+ * @return Codigo de salida del proceso.
+ */
+int ejecutarPrograma(const vector<string> &argumentos, ModoCargaPerfiles modoCarga,
+                     SincronizacionDisco sincronizacion) {
+    try {
+        Aplicacion app(modoCarga, sincronizacion);
+        if (argumentos.empty()) {
+            app.ejecutar();
+            return 0;
+        }
+        if (argumentos.front() == "--script") {
+            if (argumentos.size() != 2) {
+                Aplicacion::imprimirAyudaLote(cerr);
+                return 2;
+            }
+            if (argumentos[1] == "-") {
+                return app.ejecutarLote(cin);
+            }
+            ifstream guion(argumentos[1]);
+            if (!guion) {
+                cerr << "No se pudo abrir el guion: " << argumentos[1] << '\n';
+                return 2;
+            }
+            return app.ejecutarLote(guion);
+        }
+        ostringstream lineas;
+        for (const auto &argumento : argumentos) {
+            lineas << argumento << '\n';
+        }
+        istringstream comandos(lineas.str());
+        return app.ejecutarLote(comandos);
+    } catch (const exception &ex) {
+        cerr << "Error critico: " << ex.what() << '\n';
+        return 1;
+    }
+}
+
+/**
+ * @brief Punto de entrada del programa.
+ * @param argc Cantidad de argumentos.
+ * @param argv Argumentos; sin ellos se abre el menu, con ellos se ejecuta el modo por lotes.
+ * @return Codigo de salida del proceso.
+ */
+int main(int argc, char *argv[]) {
+    vector<string> argumentos(argv + 1, argv + argc);
+    if (!argumentos.empty() && (argumentos.front() == "--ayuda" || argumentos.front() == "-h")) {
+        Aplicacion::imprimirAyudaLote(cout);
+        return 0;
+    }
+    auto modoCarga = ModoCargaPerfiles::Completa;
+    auto sincronizacion = SincronizacionDisco::AlConfirmar;
+    bool reportarEstadisticas = false;
+    bool estadisticasJson = false;
+    while (!argumentos.empty()) {
+        const auto &opcion = argumentos.front();
+        if (opcion == "--solo-agregados") {
+            modoCarga = ModoCargaPerfiles::SoloAgregados;
+        } else if (opcion == "--stats" || opcion == "--stats=json") {
+            reportarEstadisticas = true;
+            estadisticasJson = opcion == "--stats=json";
+        } else if (opcion == "--fsync") {
+            const auto valor = argumentos.size() > 1 ? aMayusculas(argumentos[1]) : string();
+            if (valor == "NINGUNA") {
+                sincronizacion = SincronizacionDisco::Ninguna;
+            } else if (valor == "CONFIRMAR") {
+                sincronizacion = SincronizacionDisco::AlConfirmar;
+            } else if (valor == "SIEMPRE") {
+                sincronizacion = SincronizacionDisco::Siempre;
+            } else {
+                Aplicacion::imprimirAyudaLote(cerr);
+                return 2;
+            }
+            argumentos.erase(argumentos.begin());
+        } else {
+            break;
+        }
+        argumentos.erase(argumentos.begin());
+    }
+    if (!argumentos.empty()) {
+        // En modo por lotes no hay solicitudes: la salida solo se vacia al llenarse el bufer.
+        ios::sync_with_stdio(false);
+        cin.tie(nullptr);
+    }
+    const auto codigoSalida = ejecutarPrograma(argumentos, modoCarga, sincronizacion);
+    if (reportarEstadisticas) {
+        cout.flush();
+        if (estadisticasJson) {
+            Estadisticas::global().imprimirJson(cerr);
+        } else {
+            Estadisticas::global().imprimirTabla(cerr);
+        }
+    }
+    return codigoSalida;
+}
+#endif